@@ -0,0 +1,69 @@
+#ifndef PBNJ_BATCHRENDERER_H
+#define PBNJ_BATCHRENDERER_H
+
+#include <pbnj.h>
+
+#include <string>
+#include <vector>
+
+namespace pbnj {
+
+    // one image (or path) to render and how long it took
+    struct BatchJob {
+        Configuration *config;
+        // where the job came from, for reporting
+        std::string name;
+        std::string dataFilename;
+        std::string imageFilename;
+
+        bool failed;
+        // seconds spent queued between its dataset loading and rendering
+        // starting, loading the dataset (shared with every job on it),
+        // and rendering and writing the image
+        double waitTime;
+        double loadTime;
+        double renderTime;
+    };
+
+    class BatchRenderer {
+        public:
+            BatchRenderer();
+            ~BatchRenderer();
+
+            // a time series configuration becomes one job per timestep
+            void addJob(Configuration *config, std::string name="");
+            // a JSON file holding one config or an array of them, or a
+            // directory of .json config files
+            void addJobs(std::string path);
+
+            // datasets resident at once are kept under this, by default
+            // half of the free memory
+            void setMaxMemory(unsigned int gigabytes);
+            // threads loading datasets and calculating their statistics
+            // ahead of the renderer
+            void setNumWorkers(unsigned int workers);
+
+            // renders every job, jobs sharing a dataset are rendered one
+            // after another from a single load of it
+            // OSPRay must already be initialized
+            void run();
+
+            void printTimings();
+
+            std::vector<BatchJob> jobs;
+
+        private:
+            unsigned long int maxMemory;
+            unsigned int numWorkers;
+            unsigned int numDatasets;
+            double totalTime;
+
+            // shared by every job, created once OSPRay is running
+            Camera *camera;
+            Renderer *renderer;
+
+            void renderJob(BatchJob &job, Volume *volume);
+    };
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <ospray/ospray.h>
 
 #include <string>
+#include <vector>
 
 namespace pbnj {
 
@@ -15,21 +16,30 @@ namespace pbnj {
             Camera(int width, int height);
             ~Camera();
 
+            // setters only record the new state, commit() sends it to
+            // OSPRay and is called by the Renderer when the version changes
             void setPosition(float x, float y, float z);
             void setUpVector(float x, float y, float z);
+            void setViewPoint(float x, float y, float z);
             void setOrbitRadius(float radius);
+            void setImageSize(int width, int height);
             // no longer needed as the volume is centered automatically
             void centerView();
 
+            std::vector<float> getPosition();
+            std::vector<float> getUpVector();
+            float getOrbitRadius();
+
+            void commit();
+            unsigned long int getVersion();
             OSPCamera asOSPRayObject();
 
-            //some sort of setPath function that takes an enum type for the path
-            //and a ... for path parameters
+            //paths are driven from outside with CameraPath::apply()
 
             int imageWidth;
             int imageHeight;
 
-            std::string ID;
+            unsigned long int ID;
 
         private:
             float xPos;
@@ -43,6 +53,10 @@ namespace pbnj {
             float upZ;
             float orbitRadius;
 
+            // bumped by every setter
+            unsigned long int version;
+            unsigned long int committedVersion;
+
             OSPCamera oCamera;
 
             void updateOSPRayPosition();
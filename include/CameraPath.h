@@ -0,0 +1,61 @@
+#ifndef PBNJ_CAMERAPATH_H
+#define PBNJ_CAMERAPATH_H
+
+#include <pbnj.h>
+#include <Camera.h>
+#include <Configuration.h>
+
+#include <vector>
+
+namespace pbnj {
+
+    // ORBIT - circle the target around the camera's up vector
+    // SPLINE - fly through keyframed positions and view points
+    // LOOKAT - fly through keyframed positions, always facing the target
+    enum PATHTYPE {ORBIT, SPLINE, LOOKAT};
+
+    class CameraPath {
+
+        public:
+            CameraPath(PATHTYPE type);
+            CameraPath(Configuration *config);
+
+            PATHTYPE getType();
+            void setTarget(float x, float y, float z);
+            // radius <= 0 uses the camera's orbit radius, or its current
+            // distance from the target if that isn't set either
+            void setOrbit(float radius, float revolutions);
+            void setDuration(float seconds);
+            float getDuration();
+
+            // keyframes are kept sorted by time, the view point defaults
+            // to the path's target
+            void addKeyframe(float time, float x, float y, float z);
+            void addKeyframe(float time, float x, float y, float z,
+                    float viewX, float viewY, float viewZ);
+
+            // place the camera where the path is at time t, in seconds
+            void apply(Camera *camera, float t);
+            // evenly spaced times for a sequence of frames, orbits leave
+            // off the last frame since it would repeat the first
+            std::vector<float> getFrameTimes(unsigned int numFrames);
+
+        private:
+            PATHTYPE type;
+            float duration;
+            float target[3];
+            float radius;
+            float revolutions;
+
+            std::vector<float> keyTimes;
+            std::vector<float> keyPositions;
+            std::vector<float> keyViews;
+
+            void applyOrbit(Camera *camera, float t);
+            void interpolate(std::vector<float> &points, float t,
+                    float *result);
+    };
+
+}
+
+#endif
@@ -16,6 +16,8 @@ namespace pbnj {
 
             void parseConfigFile(std::string filename,
                     rapidjson::Document& config);
+            void parseConfigString(std::string text,
+                    rapidjson::Document& config);
     };
 
 }
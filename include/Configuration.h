@@ -2,6 +2,7 @@
 #define PBNJ_CONFIGURATION_H
 
 #include <ConfigReader.h>
+#include <DataFile.h>
 
 #include <string>
 #include <vector>
@@ -11,11 +12,32 @@ namespace pbnj {
     enum CONFSTATE {ERROR_NODATA, ERROR_MULTISET, SINGLE_NOVAR, SINGLE_VAR,
         MULTI_NOVAR, MULTI_VAR};
 
+    // parts of a configuration that can change independently, combined as
+    // a bitmask by Configuration::diff()
+    enum CONFCHANGE {CHANGE_NONE = 0, CHANGE_DATA = 1,
+        CHANGE_TRANSFERFUNCTION = 2, CHANGE_RANGE = 4, CHANGE_CAMERA = 8,
+        CHANGE_CAMERAPATH = 16, CHANGE_RENDERER = 32, CHANGE_OUTPUT = 64};
+
     class Configuration {
 
         public:
             Configuration(std::string filename);
+            // for configurations that don't come from a file, e.g. ones
+            // received over a socket or listed in a batch of jobs
+            Configuration(const rapidjson::Value& json);
             CONFSTATE getConfigState();
+            // what is wrong with value as the setting called name, empty
+            // if the parser can take it, e.g. before merging settings that
+            // come from a client, unknown names are ignored
+            static std::string checkSetting(std::string name,
+                    const rapidjson::Value& value);
+
+            // CONFCHANGE bits for every part that differs from other,
+            // except which files the data is in, compare getDataIdentity()
+            unsigned int diff(Configuration *other);
+            // changes whenever the data file(s) on disk change, even if
+            // the filenames stay the same
+            std::string getDataIdentity();
 
             std::string configFilename;
 
@@ -25,6 +47,13 @@ namespace pbnj {
             int dataXDim;
             int dataYDim;
             int dataZDim;
+            bool approximateStats;
+            unsigned int downsample;
+            DECIMATION decimation;
+            unsigned int quantizeBits;
+            // gigabytes of shared memory for the processes on this node to
+            // share loaded data in, 0 for none
+            unsigned int sharedMemory;
 
             int imageWidth;
             int imageHeight;
@@ -34,6 +63,11 @@ namespace pbnj {
             std::vector<float> colorMap;
             std::vector<float> opacityMap;
             float opacityAttenuation;
+            float rangeLowPercentile;
+            float rangeHighPercentile;
+            // fixed {min, max} for the transfer function, empty to follow
+            // the data
+            std::vector<float> valueRange;
 
             unsigned int samples;
 
@@ -45,11 +79,24 @@ namespace pbnj {
             float cameraUpY;
             float cameraUpZ;
 
+            // camera path for rendering a sequence of frames, the type is
+            // empty if there is no path
+            std::string cameraPathType;
+            unsigned int cameraPathFrames;
+            float cameraPathDuration;
+            float cameraPathRadius;
+            float cameraPathRevolutions;
+            std::vector<float> cameraPathTarget;
+            // 1 time and 3 position and view point components per keyframe
+            std::vector<float> keyframeTimes;
+            std::vector<float> keyframePositions;
+            std::vector<float> keyframeViews;
+
             std::vector<float> isosurfaceValues;
+            bool isosurfaceMeshes;
 
         private:
-            ConfigReader *reader;
-
+            void parse(const rapidjson::Value& json);
             void selectColorMap(std::string userInput);
             void selectOpacityMap(std::string userInput);
     };
@@ -2,6 +2,7 @@
 #define PBNJ_DATAFILE_H
 
 #include <string>
+#include <vector>
 
 #include <pbnj.h>
 
@@ -9,19 +10,93 @@ namespace pbnj {
 
     enum FILETYPE {UNKNOWN, BINARY, NETCDF};
 
+    // how the loaded data is about to be accessed, passed on to madvise
+    enum ACCESSHINT {ACCESS_NORMAL, ACCESS_SEQUENTIAL, ACCESS_RANDOM,
+        ACCESS_WILLNEED};
+
+    // how a downsampled load reduces each factor^3 box of voxels, STRIDE
+    // keeps the first voxel and skips reading most of the file, AVERAGE
+    // reads everything but filters out the aliasing
+    enum DECIMATION {DECIMATE_STRIDE, DECIMATE_AVERAGE};
+
+    // what a pass over the data finds, handed over to the DataFile as a
+    // whole, e.g. by the thread using it once a background pass is done
+    struct DataStatistics {
+        float minVal;
+        float maxVal;
+        float avgVal;
+        float stdDev;
+        MacrocellGrid *macrocells;
+        long minorFaults;
+        long majorFaults;
+    };
+
     class DataFile {
 
         public:
             DataFile(int x, int y, int z);
             ~DataFile();
 
+            // a factor above 1 keeps one value per factor^3 box as the file
+            // is read, dividing the dimensions by factor, rounded up, and
+            // memory mapping is ignored
             void loadFromFile(std::string filename, std::string variable="",
-                    bool memmap=false);
+                    bool memmap=false, bool prefault=false,
+                    unsigned int factor=1,
+                    DECIMATION decimation=DECIMATE_AVERAGE);
+            // fills in the dimensions of a NetCDF file from its header
+            // without loading anything, false if it can't be read
+            bool readDimensions(std::string filename,
+                    std::string variable="");
+            // later loads go through store, so processes on the node share
+            // one copy of each file's values, read-only
+            // raw files that are memory mapped at full resolution already
+            // share the page cache and skip it
+            void setSharedStore(SharedVolumeStore *store);
+            // whether the values are mapped from a shared store
+            bool isShared();
+            void adviseAccess(ACCESSHINT hint);
             void calculateStatistics();
+            // the same pass, without touching the DataFile, so another
+            // thread can run it while this one reads the old statistics
+            // the macrocells belong to the caller until setStatistics()
+            DataStatistics computeStatistics();
+            void setStatistics(DataStatistics stats);
+            void estimateStatistics(unsigned int samples=65536);
             void printStatistics();
 
-            // experimental
-            void bin(unsigned int num_bins);
+            // cached with the statistics, recomputed if the bin count
+            // changes or the statistics are recalculated
+            Histogram *getHistogram(unsigned int numBins=256);
+            // value below which percent (0-100) of the data falls
+            float getPercentile(float percent);
+            // per-brick value ranges, built along with the statistics
+            MacrocellGrid *getMacrocells();
+
+            // replaces the float data with 8 or 16 bit integers spread
+            // evenly over [minVal, maxVal], after calculating the exact
+            // statistics, which are kept
+            void quantize(unsigned int bits);
+            // a float copy of quantized data, e.g. for marching cubes,
+            // owned by the caller
+            DataFile *dequantize();
+            // overwrites the values with (1 - weight) * a + weight * b as
+            // floats, allocating them the first time, in parallel
+            // a and b need these dimensions, exact statistics and the same
+            // quantization, and the statistics and macrocells are blended
+            // from theirs, so min and max bound the values rather than
+            // being hit exactly
+            bool interpolate(DataFile *a, DataFile *b, float weight);
+
+            // replaces the values, quantized or not, with a lossless
+            // compressed copy, in parallel over blocks of them
+            // nothing else may touch the data until decompress()
+            void compress();
+            // false if the compressed copy was damaged
+            bool decompress();
+            bool isCompressed();
+            // memory the values take up as they are held now
+            unsigned long int getResidentBytes();
 
             std::string filename;
             FILETYPE filetype;
@@ -30,6 +105,14 @@ namespace pbnj {
             int yDim;
             int zDim;
             long int numValues;
+            // 1 for full resolution, otherwise each value stands for a
+            // downsample^3 box of the file
+            unsigned int downsample;
+            DECIMATION decimation;
+            // dimensions of the data in the file, before downsampling
+            int fileXDim;
+            int fileYDim;
+            int fileZDim;
 
             float minVal; // these should 
             float maxVal; //
@@ -37,11 +120,39 @@ namespace pbnj {
             float stdDev; //
             float *data;  // template types
 
+            // 0 unless quantize() has replaced data with quantizedData,
+            // where value = quantizeOffset + quantizeScale * quantizedData[i]
+            unsigned int quantizedBits;
+            void *quantizedData;
+            float quantizeOffset;
+            float quantizeScale;
+            // largest difference between a value and its quantized one
+            float quantizeError;
+
             bool statsCalculated;
+            bool statsApproximate;
+
+            // page faults taken while loading and scanning the data, by
+            // the threads doing that only
+            long minorFaults;
+            long majorFaults;
 
         private:
             FILETYPE getFiletype();
+            float *allocateData();
+            void freeData();
+            void computeHistogram(Histogram *histogram, bool clamp=true);
+            unsigned int getValueSize();
+            void readDecimated(FILE *dataFile, int x, int y, int z);
+            bool loadShared(std::string variable);
+
+            bool compressed;
+            std::vector<std::vector<unsigned char> > compressedBlocks;
             bool wasMemoryMapped;
+            SharedVolumeStore *sharedStore;
+            bool wasShared;
+            Histogram *histogram;
+            MacrocellGrid *macrocells;
     };
 
 }
@@ -0,0 +1,48 @@
+#ifndef PBNJ_HISTOGRAM_H
+#define PBNJ_HISTOGRAM_H
+
+#include <pbnj.h>
+
+#include <vector>
+
+namespace pbnj {
+
+    class Histogram {
+
+        public:
+            Histogram(unsigned int numBins, float minimum, float maximum);
+
+            // bin count values in parallel, each thread fills a private
+            // histogram and they are merged at the end
+            // values outside the range go to the end bins, or are skipped
+            // if clamp is false
+            void compute(const float *data, long int count, bool clamp=true);
+            // quantized data standing for offset + scale * data[i]
+            void compute(const unsigned char *data, long int count,
+                    float offset, float scale, bool clamp=true);
+            void compute(const unsigned short *data, long int count,
+                    float offset, float scale, bool clamp=true);
+
+            unsigned int getNumBins();
+            // value below which percent (0-100) of the values fall
+            float getPercentile(float percent);
+            // log10(1 + count) per bin, for display
+            std::vector<float> getLogCounts();
+
+            float minVal;
+            float maxVal;
+            unsigned long int total;
+
+            std::vector<unsigned long int> counts;
+            // numBins + 1 bin edges, bin i covers [edges[i], edges[i+1])
+            std::vector<float> edges;
+
+        private:
+            template<typename T>
+            void computeScaled(const T *data, long int count, float offset,
+                    float scale, bool clamp);
+    };
+
+}
+
+#endif
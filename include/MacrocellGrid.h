@@ -0,0 +1,52 @@
+#ifndef PBNJ_MACROCELLGRID_H
+#define PBNJ_MACROCELLGRID_H
+
+#include <pbnj.h>
+
+#include <vector>
+
+namespace pbnj {
+
+    class MacrocellGrid {
+
+        public:
+            // bricks of brickSize^3 cells over an x by y by z voxel grid
+            // a brick covers the voxels at the corners of its cells, so
+            // neighbouring bricks share a face of voxels
+            MacrocellGrid(int x, int y, int z, int brickSize=16);
+
+            long int getNumBricks();
+            long int getBrick(int bx, int by, int bz);
+            // first and last voxel of a brick along each axis, inclusive
+            void getBrickVoxels(long int brick, int *lo, int *hi);
+
+            // widen a brick's range to cover the values given
+            void include(long int brick, float minimum, float maximum);
+            // whether a brick's cells can have values on both sides of the
+            // isovalue, i.e. an isosurface can pass through it
+            bool crossesIsovalue(long int brick, float isovalue);
+            // whether a brick can hold any value in [low, high]
+            bool overlapsRange(long int brick, float low, float high);
+
+            // bricks that aren't fully transparent under tf
+            std::vector<bool> getVisibleBricks(TransferFunction *tf);
+            // {x0, y0, z0, x1, y1, z1} inclusive voxel box around the
+            // bricks that are set, empty if none of them are
+            std::vector<int> getBounds(const std::vector<bool> &bricks);
+
+            int xDim;
+            int yDim;
+            int zDim;
+            int brickSize;
+            int xBricks;
+            int yBricks;
+            int zBricks;
+
+            // per brick, x fastest
+            std::vector<float> minimums;
+            std::vector<float> maximums;
+    };
+
+}
+
+#endif
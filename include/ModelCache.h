@@ -0,0 +1,49 @@
+#ifndef PBNJ_MODELCACHE_H
+#define PBNJ_MODELCACHE_H
+
+#include <pbnj.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+
+#include <ospray/ospray.h>
+
+namespace pbnj {
+
+    /* OSPRay models shared by every Renderer that draws the same volume.
+     *
+     * Models are reference counted, a few that nobody holds are kept
+     * around so that switching back and forth between volumes doesn't
+     * rebuild them. Safe to use from any thread.
+     */
+    class ModelCache {
+        public:
+            ModelCache(unsigned int maxUnused=16);
+            ~ModelCache();
+
+            // the model holding v, built on first use
+            // every acquire() needs a matching release()
+            OSPModel acquire(Volume *v);
+            void release(unsigned long int volumeID);
+            // recommits the model if v changed since it was last committed
+            void commit(Volume *v);
+
+            unsigned int size();
+
+        private:
+            struct Entry {
+                OSPModel model;
+                unsigned int references;
+                unsigned long int volumeVersion;
+            };
+
+            std::mutex lock;
+            std::map<unsigned long int, Entry> models;
+            // volume IDs of unreferenced models, oldest first
+            std::list<unsigned long int> unused;
+            unsigned int maxUnused;
+    };
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef PBNJ_RANGEINDEX_H
+#define PBNJ_RANGEINDEX_H
+
+#include <pbnj.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pbnj {
+
+    class RangeIndex {
+
+        public:
+            // one entry per file of a time series, empty until the file is
+            // indexed by build() or add(), or read back with load()
+            RangeIndex(std::vector<std::string> filenames, int x, int y,
+                    int z, std::string variable="");
+            ~RangeIndex();
+
+            // reads a saved index, entries for files that have changed
+            // since it was saved are left out
+            bool load(std::string indexFilename);
+            bool save(std::string indexFilename);
+
+            // indexes the remaining timesteps on a background thread, one
+            // at a time, and saves the index to indexFilename afterwards
+            // if one is given
+            void build(std::string indexFilename="");
+            // blocks until build() is done
+            void wait();
+
+            // records a timestep whose macrocells are already computed,
+            // e.g. by a TimeSeries as it loads a volume
+            void add(unsigned int timestep, MacrocellGrid *grid);
+
+            bool isIndexed(unsigned int timestep);
+            unsigned int getNumIndexed();
+            // smallest and largest value of the whole series, false until
+            // every timestep is indexed
+            bool getValueRange(float &minimum, float &maximum);
+
+            // queries never load data, timesteps that aren't indexed yet
+            // can't be ruled out and are always included
+            // timesteps that may hold values in [low, high]
+            std::vector<unsigned int> findTimesteps(float low, float high);
+            // timesteps an isosurface passes through
+            std::vector<unsigned int> findTimesteps(float isovalue);
+            // bricks of one timestep, numbered as by MacrocellGrid, or
+            // nothing if it isn't indexed
+            std::vector<long int> findBricks(unsigned int timestep,
+                    float low, float high);
+            std::vector<long int> findBricks(unsigned int timestep,
+                    float isovalue);
+
+        private:
+            struct Entry {
+                // file name, size and modification time when indexed
+                std::string identity;
+                float minimum;
+                float maximum;
+                // NULL if not indexed
+                MacrocellGrid *grid;
+            };
+            std::vector<std::string> filenames;
+            std::string variable;
+            int xDim;
+            int yDim;
+            int zDim;
+            std::vector<Entry> entries;
+            std::mutex lock;
+
+            std::thread builder;
+            std::atomic<bool> stopping;
+            void buildEntries(std::string indexFilename);
+
+            std::string getIdentity(unsigned int timestep);
+            // isosurface queries pass low == high and need values on both
+            // sides of it
+            std::vector<unsigned int> findTimesteps(float low, float high,
+                    bool isosurface);
+            std::vector<long int> findBricks(unsigned int timestep,
+                    float low, float high, bool isosurface);
+    };
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef PBNJ_RENDERSERVER_H
+#define PBNJ_RENDERSERVER_H
+
+#include <pbnj.h>
+#include <RenderSession.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+namespace pbnj {
+
+    /* Serves frames of a Scene over a TCP or Unix socket.
+     *
+     * Clients send one JSON object per line. Its members use the same
+     * names as a config file and replace the server's current settings,
+     * e.g. {"cameraPosition": [0, 0, 512], "colorMap": "magma"}, plus:
+     *  - "timestep": index of the time series volume to render
+     *  - "fullResolution": true to render it without the configured
+     *    downsampling, e.g. once playback pauses
+     *  - "time": a point between timesteps to render instead, e.g. 2.25
+     *    blends a quarter of timestep 3 into timestep 2, one blend is
+     *    shared by every client
+     *  - "format": "png" (default) or "raw" for RGBA rows, top row first
+     *  - "render": false to apply changes without getting a frame back
+     *  - "shutdown": true to stop the server
+     * Every request gets a single line JSON reply, e.g.
+     *  {"status": "ok", "width": 512, "height": 512, "format": "png",
+     *   "bytes": 12345, "changes": 8, "renderTime": 0.021,
+     *   "queueTime": 0.004, "dropped": 3}
+     * followed by "bytes" bytes of image data.
+     *
+     * Requests that arrive while a frame renders are coalesced, only the
+     * newest state is rendered and superseded requests are answered with
+     * {"status": "dropped", "bytes": 0}. Frames are rendered progressively
+     * and abandoned as soon as a newer request arrives.
+     *
+     * Clients are served concurrently from a RendererPool. The camera,
+     * image size, samples, background color, isosurfaces and timestep
+     * belong to each client, the data and transfer function are shared by
+     * all of them.
+     */
+    class RenderServer {
+        public:
+            // requests are applied on top of the settings in this file
+            // numRenderers 0 means one renderer per core
+            RenderServer(std::string configFilename,
+                    unsigned int numRenderers=0);
+            ~RenderServer();
+
+            // port 0 picks any free port, see getPort()
+            bool listenTCP(unsigned short port,
+                    std::string address="127.0.0.1");
+            bool listenUnix(std::string path);
+            unsigned short getPort();
+
+            // handles connections until a client asks for a shutdown,
+            // OSPRay must already be initialized
+            void serve();
+
+            Scene *getScene();
+            RendererPool *getRendererPool();
+
+        private:
+            // settings shared by every client, guarded by the pool's
+            // object lock
+            rapidjson::Document config;
+            std::string configFilename;
+            Scene *scene;
+            RendererPool *pool;
+            unsigned int numRenderers;
+
+            int listenSocket;
+            unsigned short port;
+            std::string socketPath;
+            std::atomic<bool> running;
+            std::atomic<unsigned long int> frames;
+            std::mutex clientLock;
+            std::set<int> clients;
+            std::condition_variable connectionsDone;
+
+            void handleConnection(int client);
+            // these return false when the connection should be closed
+            bool handleRequests(RenderSession &session,
+                    std::vector<SessionRequest> &requests);
+            bool renderNewest(RenderSession &session,
+                    SessionRequest &request, bool render, bool raw,
+                    bool sharedChanged);
+            bool reply(int client, std::string header,
+                    const std::vector<unsigned char> &data);
+            bool replyDropped(int client);
+            bool replyError(int client, std::string message);
+    };
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef PBNJ_RENDERSESSION_H
+#define PBNJ_RENDERSESSION_H
+
+#include <pbnj.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+namespace pbnj {
+
+    struct SessionRequest {
+        std::string text;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    /* Latest-wins mailbox for the requests of one client.
+     *
+     * A reader posts requests as they arrive and the renderer takes
+     * everything that is pending at once, so a burst of camera moves
+     * becomes a single frame of the newest state instead of a queue of
+     * stale ones.
+     */
+    class RenderSession {
+        public:
+            RenderSession(int socket);
+
+            void post(std::string request);
+            // puts back a request whose frame was cancelled, ahead of
+            // anything newer, so it's either superseded or rendered
+            void requeue(SessionRequest &request);
+            // the client has gone, take() returns false once drained
+            void close();
+            // waits for at least one request and moves all pending ones
+            // into requests, oldest first
+            bool take(std::vector<SessionRequest> &requests);
+            // whether anything newer has arrived, e.g. to cancel a frame
+            bool hasPending();
+            // a steady stream of requests could cancel every frame, so
+            // only one is cancelled between finished frames
+            bool mayCancel();
+
+            // add the time a request waited before its frame started
+            void recordLatency(double seconds);
+            void printMetrics();
+
+            int socket;
+            unsigned long int ID;
+
+            // the client's own view of the scene, shared settings live in
+            // the server
+            rapidjson::Document config;
+            Configuration *lastConfig;
+            Camera *camera;
+            unsigned int timestep;
+            // the timestep at the file's resolution, e.g. while paused
+            bool fullResolution;
+            // between timesteps, e.g. 2.25, negative when a whole
+            // timestep was asked for
+            float time;
+
+            unsigned long int received;
+            unsigned long int rendered;
+            // requests answered without a frame of their own because a
+            // newer one arrived, before or during their render
+            unsigned long int dropped;
+            unsigned long int cancelled;
+            bool cancelledLast;
+            double totalLatency;
+            double maxLatency;
+
+        private:
+            std::mutex lock;
+            std::condition_variable arrived;
+            std::deque<SessionRequest> pending;
+            bool closed;
+    };
+}
+
+#endif
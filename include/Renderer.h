@@ -3,6 +3,8 @@
 
 #include <pbnj.h>
 
+#include <functional>
+#include <list>
 #include <string>
 #include <vector>
 
@@ -17,17 +19,63 @@ namespace pbnj {
             Renderer();
             ~Renderer();
 
+            // parameter changes are recorded and committed together by the
+            // next render()
             void setBackgroundColor(unsigned char r, unsigned char g, unsigned char b);
             void setBackgroundColor(std::vector<unsigned char> bgColor);
             void setVolume(Volume *v);
             void setIsosurface(Volume *v, std::vector<float> &isoValues);
+            // forget the volume before it's deleted, e.g. evicted from a
+            // time series, the next setVolume() or setIsosurface() brings
+            // one back
+            void detachVolume();
             void setCamera(Camera *c);
             void setSamples(unsigned int spp);
+            // accumulate the samples one pass at a time so that a frame
+            // can be abandoned part way through
+            void setProgressive(bool progressive);
+
+            // volume models come from a shared cache instead of being
+            // built by this renderer
+            void setModelCache(ModelCache *cache);
+            // how many isosurfaces are kept around for switching back to
+            // without rebuilding them, default 8
+            void setIsosurfaceCacheSize(unsigned int numSurfaces);
+            // draw isosurfaces as extracted triangle meshes, which are
+            // slow to change but much faster to render than intersecting
+            // the volume along every ray
+            void setIsosurfaceMeshes(bool meshes);
 
             void render();
-            void renderToBuffer(unsigned char **buffer);
-            void renderToPNGObject(std::vector<unsigned char> &png);
+            // gives up between progressive passes once cancelled() returns
+            // true, returns false if the frame was abandoned
+            bool render(std::function<bool()> cancelled);
+            // render() is commit() followed by renderFrame(), split so that
+            // renderers sharing volumes can commit one at a time and then
+            // render concurrently
+            bool commit();
+            bool renderFrame(std::function<bool()> cancelled=nullptr);
+            // doRender=false reads back the last frame instead of
+            // rendering a new one
+            void renderToBuffer(unsigned char **buffer, bool doRender=true);
+            void renderToPNGObject(std::vector<unsigned char> &png,
+                    bool doRender=true);
             void renderImage(std::string imageFilename);
+            // render one frame per step along the path into a numbered
+            // family of images, e.g. out.png -> out0000.png, out0001.png
+            // each image is written out while the next frame renders
+            void renderPath(Camera *c, CameraPath *path, unsigned int numFrames,
+                    std::string imageFilename);
+            // the name renderPath() gives a frame, e.g. out.png, 3 ->
+            // out0003.png, or out, 3 -> out0003 without an extension
+            static std::string frameFilename(std::string filename,
+                    unsigned int frame);
+            // INVALID unless the extension is .png or .ppm
+            static IMAGETYPE getFiletype(std::string filename);
+            // encodes top-to-bottom RGBA rows and writes them out
+            static void writeImage(std::string filename, IMAGETYPE imageType,
+                    const std::vector<unsigned char> &rgba, int width,
+                    int height);
 
             int cameraWidth;
             int cameraHeight;
@@ -35,26 +83,64 @@ namespace pbnj {
             unsigned char backgroundColor[3];
 
             OSPRenderer oRenderer;
+            // kept between frames and only recreated when the size changes
             OSPFrameBuffer oFrameBuffer;
+            osp::vec2i frameBufferSize;
             OSPModel oModel;
             OSPCamera oCamera;
-            OSPGeometry oSurface;
             OSPMaterial oMaterial;
+            OSPData oLights;
 
-            IMAGETYPE getFiletype(std::string filename);
             void saveImage(std::string filename, IMAGETYPE imageType);
 
-            void saveAsPPM(std::string filename);
-            void saveAsPNG(std::string filename);
-            void bufferToPNG(std::vector<unsigned char> &png);
+            // composite the framebuffer onto the background color as
+            // top-to-bottom RGBA rows
+            void compositeFrame(unsigned char *buffer);
+
+            Volume *volume;
+            Camera *camera;
+            unsigned long int cameraVersion;
+            // renderer parameters changed since the last commit
+            bool dirty;
 
-            std::string lastVolumeID;
-            std::string lastCameraID;
+            // zero when nothing has been set
+            unsigned long int lastVolumeID;
+            unsigned long int lastVolumeVersion;
+            unsigned long int lastCameraID;
             std::string lastRenderType;
             std::vector<float> lastIsoValues;
 
             std::vector<OSPLight> lights;
+            // lights and material are made once and shared by every
+            // isosurface this renderer draws
+            void setupLighting();
+
+            struct Isosurface {
+                unsigned long int volumeID;
+                unsigned long int volumeVersion;
+                std::vector<float> isoValues;
+                bool meshes;
+                // the implicit surface, or one mesh per isovalue
+                OSPGeometry oGeometry;
+                OSPData oIsoValues;
+                std::vector<OSPGeometry> oMeshes;
+                OSPModel oModel;
+            };
+            // most recently used first, oModel is the front one's model
+            // while rendering isosurfaces
+            std::list<Isosurface> isosurfaces;
+            unsigned int maxIsosurfaces;
+            bool meshIsosurfaces;
+            void releaseIsosurface(Isosurface &surface);
+            OSPGeometry createMeshGeometry(Volume *v, float isovalue);
+
             unsigned int samples;
+            bool progressive;
+
+            ModelCache *modelCache;
+            // whether oModel belongs to the cache
+            bool modelCached;
+            void releaseModel();
     };
 }
 
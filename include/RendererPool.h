@@ -0,0 +1,89 @@
+#ifndef PBNJ_RENDERERPOOL_H
+#define PBNJ_RENDERERPOOL_H
+
+#include <pbnj.h>
+#include <ModelCache.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace pbnj {
+
+    /* A fixed set of Renderers shared by any number of sessions.
+     *
+     * Sessions are spread over the renderers and take turns on the one
+     * they're assigned. Every renderer gets its volume models from one
+     * ModelCache, so a volume viewed by many sessions is only resident
+     * once. Changes to shared objects (volumes, transfer functions,
+     * renderers) are made under getObjectLock() one at a time, and only
+     * the frames themselves render concurrently.
+     *
+     * That is safe with the local device ospInit() sets up: creating,
+     * committing and releasing objects changes the device's shared state,
+     * but ospRenderFrame() only reads the committed renderer, model and
+     * camera and writes its own frame buffer, so frames on separate
+     * renderer and frame buffer pairs don't touch each other.
+     */
+    class RendererPool {
+        public:
+            // 0 means one renderer per core
+            RendererPool(unsigned int numRenderers=0);
+            ~RendererPool();
+
+            // at most this many frames render at once, by default the
+            // number of cores
+            void setMaxConcurrent(unsigned int renders);
+
+            // sessions are assigned to the renderer with the fewest
+            // sessions, acquire() does this on first use
+            void assign(unsigned long int sessionID);
+            void unassign(unsigned long int sessionID);
+
+            // exclusive use of the session's renderer until release()
+            Renderer *acquire(unsigned long int sessionID);
+            void release(unsigned long int sessionID);
+
+            // commit(), renderFrame() and finishFrame() in one go
+            bool render(Renderer *r, std::function<bool()> cancelled=nullptr);
+            // commits r with the object lock already held, if this succeeds
+            // the frame is in flight until finishFrame()
+            bool commit(Renderer *r);
+            // renders a committed r once a render slot is free
+            bool renderFrame(Renderer *r,
+                    std::function<bool()> cancelled=nullptr);
+            // after reading back the frame and letting go of its objects
+            void finishFrame();
+
+            // held while changing volumes, transfer functions or renderers
+            // frames in flight still read the objects they were committed
+            // with, so wait for them before changing anything shared
+            std::mutex &getObjectLock();
+            void waitForFrames(std::unique_lock<std::mutex> &objectGuard);
+            ModelCache *getModelCache();
+            unsigned int getNumRenderers();
+
+        private:
+            ModelCache modelCache;
+            std::vector<Renderer *> renderers;
+            // one per renderer, held between acquire() and release()
+            std::vector<std::mutex *> rendererLocks;
+            std::vector<unsigned int> sessionCounts;
+            std::map<unsigned long int, unsigned int> sessions;
+            std::mutex sessionLock;
+
+            std::mutex objectLock;
+            // frames committed and not yet finished, guarded by objectLock
+            unsigned int framesInFlight;
+            std::condition_variable framesDone;
+
+            unsigned int maxConcurrent;
+            unsigned int activeRenders;
+            std::mutex renderLock;
+            std::condition_variable renderSlots;
+    };
+}
+
+#endif
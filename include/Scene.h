@@ -0,0 +1,60 @@
+#ifndef PBNJ_SCENE_H
+#define PBNJ_SCENE_H
+
+#include <pbnj.h>
+
+#include <string>
+
+namespace pbnj {
+
+    class Scene {
+        public:
+            // builds everything config describes, OSPRay must already be
+            // initialized
+            Scene(Configuration *config);
+            ~Scene();
+
+            // bring the scene in line with a new configuration, touching
+            // only the objects whose settings changed
+            // the data is only reloaded if the file(s) on disk differ
+            // returns the CONFCHANGE bits that were applied
+            unsigned int apply(Configuration *config);
+
+            // which volume of a time series to render, a downsampled
+            // series can show it at full resolution, e.g. when paused
+            void setTimestep(unsigned int index, bool fullResolution=false);
+            // a fractional timestep blends its neighbours, e.g. to play a
+            // series back smoothly, see TimeSeries::getInterpolatedVolume()
+            void setTime(float time);
+
+            Configuration *getConfiguration();
+            Volume *getVolume();
+            // NULL when the scene holds a single volume
+            TimeSeries *getTimeSeries();
+            Camera *getCamera();
+            Renderer *getRenderer();
+
+        private:
+            // a copy of the last configuration applied
+            Configuration *config;
+            std::string dataIdentity;
+
+            Volume *volume;
+            TimeSeries *timeSeries;
+            unsigned int timestep;
+            // created the first time data is loaded through it, and kept
+            // until the scene is deleted
+            SharedVolumeStore *sharedStore;
+            Camera *camera;
+            Renderer *renderer;
+
+            bool loadData();
+            void applyTransferFunction();
+            void applyRange();
+            void applyCamera();
+            void applyRenderer();
+            void setRenderTarget();
+    };
+}
+
+#endif
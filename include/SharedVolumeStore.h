@@ -0,0 +1,83 @@
+#ifndef PBNJ_SHAREDVOLUMESTORE_H
+#define PBNJ_SHAREDVOLUMESTORE_H
+
+#include <pbnj.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+namespace pbnj {
+
+    /* Volume data shared by every process on a node through POSIX shared
+     * memory.
+     *
+     * Each piece of data lives in its own segment, named after a key that
+     * identifies it, e.g. the file, its size and modification time. The
+     * first process to ask for a key fills the segment and every process
+     * after it maps the same pages read-only. A table in one more segment
+     * counts the references each process holds to each one and keeps
+     * their total under a budget for the whole node. Segments nobody
+     * references stay around for the next process until the budget needs
+     * their space.
+     */
+    class SharedVolumeStore {
+        public:
+            // processes using the same name share the store, the budget
+            // of the first one to open it holds until setMaxBytes()
+            SharedVolumeStore(unsigned long int maxBytes,
+                    std::string name="/pbnj-volumes");
+            // references this process still holds are given up
+            ~SharedVolumeStore();
+
+            // false if the shared memory couldn't be set up
+            bool isOpen();
+            void setMaxBytes(unsigned long int maxBytes);
+            unsigned long int getMaxBytes();
+            unsigned long int getUsedBytes();
+
+            // a read-only mapping of the data for key, which fill() writes
+            // if no process has published it yet, blocks while another
+            // process is filling it
+            // NULL if it doesn't fit in the budget or the shared memory,
+            // the key is too long or fill() fails, the caller should then
+            // load the data privately
+            const void *acquire(std::string key, size_t bytes,
+                    std::function<bool(void *)> fill);
+            // every acquire() needs one release() with its mapping
+            void release(const void *data);
+
+            // removes the segments nobody references
+            void purge();
+
+        private:
+            struct Header;
+            std::string name;
+            Header *header;
+
+            // this process's mappings, their sizes and the entries they
+            // belong to
+            struct Mapping {
+                size_t bytes;
+                int entry;
+            };
+            std::map<const void *, Mapping> mappings;
+            std::mutex mappingLock;
+
+            void lock();
+            void unlock();
+            std::string getSegmentName(uint64_t hash);
+            // with the header locked
+            int findEntry(std::string key);
+            bool makeRoom(size_t bytes);
+            // counting forgets the references of processes that died
+            int countReferences(int entry);
+            bool addReference(int entry);
+            void removeReference(int entry);
+            void removeEntry(int entry);
+    };
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PBNJ_THUMBNAILRENDERER_H
+#define PBNJ_THUMBNAILRENDERER_H
+
+#include <pbnj.h>
+#include <DataFile.h>
+
+#include <string>
+#include <vector>
+
+namespace pbnj {
+
+    /* Small previews of every timestep of a series.
+     *
+     * Loader threads read the timesteps downsampled, a few at a time under
+     * a memory budget, while several renderers turn the loaded ones into
+     * thumbnails concurrently and encode and write them as they finish.
+     * OSPRay objects are only created and committed one thread at a time,
+     * the frames themselves render in parallel.
+     *
+     * Every thumbnail is colored over one range, the configured value
+     * range or else the range of the whole series, found by a quick
+     * strided read of every timestep before any of them are rendered.
+     */
+    class ThumbnailRenderer {
+        public:
+            // one thumbnail per file of config, named after its image
+            // filename with the timestep number, e.g. out.png ->
+            // out0000.png, out0001.png
+            ThumbnailRenderer(Configuration *config);
+            ~ThumbnailRenderer();
+
+            // by default 128 pixels wide with the configured aspect ratio
+            void setImageSize(int width, int height);
+            // by default the data is cut down until it is about as many
+            // voxels across as the thumbnail is pixels
+            void setDownsample(unsigned int factor,
+                    DECIMATION decimation=DECIMATE_AVERAGE);
+            // timesteps loaded and waiting to render are kept under this,
+            // by default half of the free memory
+            void setMaxMemory(unsigned int gigabytes);
+            // threads reading timesteps and calculating their statistics
+            void setNumWorkers(unsigned int workers);
+            // frames rendering at once
+            void setNumRenderers(unsigned int renderers);
+
+            // renders and writes every thumbnail, the images are kept for
+            // saveMontage()
+            // OSPRay must already be initialized
+            void run();
+
+            // every thumbnail on one image, in rows of columns of them, 0
+            // picks a roughly square grid
+            bool saveMontage(std::string filename, unsigned int columns=0);
+
+            void printTimings();
+
+            std::vector<std::string> imageFilenames;
+            // RGBA rows of each thumbnail, empty if it failed
+            std::vector<std::vector<unsigned char>> images;
+
+        private:
+            Configuration *config;
+            int imageWidth;
+            int imageHeight;
+            unsigned int downsample;
+            DECIMATION decimation;
+            unsigned long int maxMemory;
+            unsigned int numWorkers;
+            unsigned int numRenderers;
+
+            double loadTime;
+            double renderTime;
+            double totalTime;
+    };
+}
+
+#endif
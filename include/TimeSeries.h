@@ -10,6 +10,15 @@
 
 namespace pbnj {
 
+    // lookups, and what one tier of a TimeSeries cache is holding
+    struct CacheTierStatistics {
+        unsigned long int hits;
+        unsigned long int misses;
+        unsigned long int bytes;
+        unsigned long int maxBytes;
+        unsigned int volumes;
+    };
+
     class TimeSeries {
 
         public:
@@ -18,36 +27,140 @@ namespace pbnj {
                     int x, int y, int z);
             ~TimeSeries();
 
+            // NULL if the timestep couldn't be loaded
             Volume *getVolume(unsigned int index);
+            // the timestep at the file's own resolution when the series
+            // is downsampled, e.g. once playback pauses on it
+            // only the last one asked for is kept, outside the memory
+            // limit, and it stays valid until another timestep is asked
+            // for this way
+            Volume *getFullResolutionVolume(unsigned int index);
+            // the series between timesteps for smooth playback, e.g. 2.25
+            // blends a quarter of timestep 3 into timestep 2, loading them
+            // if they aren't resident
+            // it's one volume, outside the memory limit, whose values are
+            // rewritten in place on each call, so a renderer only has to
+            // recommit it, it stays valid until the resolution changes
+            // NULL if a neighbour couldn't be loaded or blended
+            Volume *getInterpolatedVolume(float time);
+            // whether getInterpolatedVolume() can return the volume as it
+            // is, without loading or blending anything into it
+            bool isInterpolated(float time);
+            // whether getVolume() can return without loading anything
+            bool isLoaded(unsigned int index);
+            // the same for getFullResolutionVolume()
+            bool isFullResolutionLoaded(unsigned int index);
             int getVolumeIndex(std::string filename);
             unsigned int getLength();
             void setMaxMemory(unsigned int gigabytes);
+            // evicted volumes are kept losslessly compressed in memory, up
+            // to this much of it, and decompressed when they're needed
+            // again instead of being read back from disk, off by default
+            void setCompressedMemory(unsigned int gigabytes);
+            // the resident volumes, and the compressed ones behind them
+            CacheTierStatistics getResidentStatistics();
+            CacheTierStatistics getCompressedStatistics();
+            void printCacheStatistics();
+            // a pinned volume is never evicted to make room for another,
+            // e.g. while a renderer is using it; pins are counted
+            void pin(unsigned int index);
+            void unpin(unsigned int index);
 
             // attributes for volumes to receive when loaded
             std::vector<float> colorMap;
             std::vector<float> opacityMap;
             float opacityAttenuation;
             bool doMemoryMap;
+            bool doPrefault;
+            bool doApproximateStats;
+            float lowPercentile;
+            float highPercentile;
+            unsigned int downsample;
+            DECIMATION decimation;
+            unsigned int quantizeBits;
+            SharedVolumeStore *sharedStore;
 
             void setColorMap(std::vector<float> &map);
             void setOpacityMap(std::vector<float> &map);
             void setOpacityAttenuation(float attenuation);
             void setMemoryMapping(bool toMMap);
+            void setMemoryPrefault(bool toPrefault);
+            void setApproximateStatistics(bool toApproximate);
+            // also recolors the resident timesteps, starting the shared
+            // range over from them unless it's fixed
+            void setRangePercentiles(float low, float high);
+            // volumes loaded from now on keep one value per factor^3 box,
+            // which lets factor^3 times as many of them fit in memory
+            void setDownsample(unsigned int factor,
+                    DECIMATION decimation=DECIMATE_AVERAGE);
+            // volumes loaded from now on are held as 8 or 16 bit values
+            // scaled to each one's range, fitting 4 or 2 times as many in
+            // memory, 0 keeps them as floats
+            // quantized volumes always calculate exact statistics
+            void setQuantization(unsigned int bits);
+            // largest error quantizing has made in any volume so far
+            float getQuantizationError();
+            // volumes loaded from now on read their values through store,
+            // shared with other processes, which must outlive the series
+            // NULL loads them privately, the default, as do quantized
+            // series
+            void setSharedStore(SharedVolumeStore *store);
+
+            // one transfer function is shared by every volume in the
+            // series, its range grows to cover each timestep as it loads
+            // until the range index covers them all, then it's theirs
+            TransferFunction *getTransferFunction();
+            // colors every timestep over [minimum, maximum] instead of the
+            // range of the timesteps loaded so far
+            void setValueRange(float minimum, float maximum);
+
+            // value ranges of every timestep and brick, filled in as
+            // volumes load with exact statistics
+            RangeIndex *getRangeIndex();
+            // reads the index saved in indexFilename, if any, and scans
+            // the timesteps it's missing in the background, saving it
+            // again afterwards
+            // once it's complete the series is colored over its whole
+            // range, whatever has been loaded
+            void indexRanges(std::string indexFilename="");
 
         private:
             int xDim;
             int yDim;
             int zDim;
             unsigned int dataSize;
+            unsigned long maxBytes;
             unsigned int maxVolumes;
+            void updateMaxVolumes();
             unsigned int currentVolumes;
             std::list<int> lruCache;
+            std::vector<unsigned int> pins;
             void encache(unsigned int index);
+            void evict(unsigned int index);
+            CacheTierStatistics residentStatistics;
+
+            // least recently used first, like lruCache
+            std::list<int> compressedCache;
+            std::vector<DataFile *> compressedData;
+            CacheTierStatistics compressedStatistics;
+            Volume *restoreVolume(unsigned int index);
+            void clearCompressed();
+            void trimCompressed();
 
             unsigned int length;
             std::vector<std::string> dataFilenames;
             std::string dataVariable;
             Volume **volumes;
+            float quantizationError;
+            Volume *fullVolume;
+            unsigned int fullVolumeIndex;
+            Volume *loadVolume(unsigned int index, unsigned int factor);
+            Volume *interpolatedVolume;
+            float interpolatedTime;
+
+            TransferFunction *transferFunction;
+            RangeIndex *rangeIndex;
+            void expandRange(Volume *volume);
 
             struct sysinfo systemInfo;
             void initSystemInfo();
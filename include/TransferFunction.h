@@ -10,12 +10,14 @@
 namespace pbnj {
 
     // named color maps
+    extern std::vector<float> blackToWhite;
     extern std::vector<float> coolToWarm;
     extern std::vector<float> spectralReverse;
     extern std::vector<float> magma;
     extern std::vector<float> viridis;
 
     // named opacity maps
+    extern std::vector<float> ramp;
     extern std::vector<float> reverseRamp;
     extern std::vector<float> teeth;
     extern std::vector<float> exponential;
@@ -34,23 +36,67 @@ namespace pbnj {
             
             // enum for known color maps
 
+            // changes are only recorded here, commit() hands them to
+            // OSPRay, which the Renderer does once per frame
             void setRange(float minimum, float maximum);
+            std::vector<float> getRange();
+            // widens the range to cover [minimum, maximum], the first call
+            // replaces the default one, e.g. as volumes sharing this load
+            // does nothing while the range is fixed
+            void includeRange(float minimum, float maximum);
+            // holds the range at [minimum, maximum] whatever is included,
+            // e.g. a range chosen for a whole series up front
+            void fixRange(float minimum, float maximum);
+            void unfixRange();
+            bool isRangeFixed();
+            // scales the opacity map by amount, replacing any previous
+            // attenuation rather than compounding it
             void attenuateOpacity(float amount);
             void setColorMap(std::vector<float> &map);
             void setOpacityMap(std::vector<float> &map);
+            // highest opacity any value in [low, high] is mapped to,
+            // zero means the whole range is invisible
+            float getMaxOpacity(float low, float high);
+            // bumped whenever the opacity of some value may have changed
+            unsigned long int getOpacityVersion();
 
+            void commit();
             OSPTransferFunction asOSPObject();
+            // the same mapping for data stored as (value - offset) / scale,
+            // e.g. quantized volumes, kept in step by commit()
+            OSPTransferFunction createScaledOSPObject(float offset,
+                    float scale);
+            void releaseScaledOSPObject(OSPTransferFunction scaled);
             
         private:
 
             std::vector<float> colorMap;
+            // the map as set, and the attenuated copy OSPRay reads from
+            std::vector<float> baseOpacityMap;
             std::vector<float> opacityMap;
+            float attenuation;
             float minVal;
             float maxVal;
+            bool rangeIncluded;
+            bool rangeFixed;
+            bool dirty;
+            unsigned long int opacityVersion;
 
+            // the data arrays share the vectors' memory and are only
+            // recreated when a map changes length
             OSPTransferFunction oTF;
             OSPData oColorData;
             OSPData oOpacityData;
+
+            void updateOpacity();
+
+            struct ScaledCopy {
+                float offset;
+                float scale;
+                OSPTransferFunction oTF;
+            };
+            std::vector<ScaledCopy> scaledCopies;
+            void updateScaledCopy(ScaledCopy &copy);
     };
 }
 
@@ -0,0 +1,40 @@
+#ifndef PBNJ_TRIANGLEMESH_H
+#define PBNJ_TRIANGLEMESH_H
+
+#include <pbnj.h>
+
+#include <string>
+#include <vector>
+
+namespace pbnj {
+
+    class TriangleMesh {
+
+        public:
+            // extracts the isovalue surface of df with marching cubes, in
+            // parallel over slabs of the volume
+            // voxels above the isovalue are inside the surface and the
+            // normals point away from them
+            TriangleMesh(DataFile *df, float isovalue);
+
+            // binary little endian PLY with per-vertex normals
+            bool save(std::string filename);
+
+            long int getNumVertices();
+            long int getNumTriangles();
+
+            float isovalue;
+            // x, y, z per vertex in voxel coordinates, shared by every
+            // triangle that touches the vertex
+            std::vector<float> vertices;
+            std::vector<float> normals;
+            // three vertex indices per triangle
+            std::vector<int> triangles;
+
+        private:
+            void extract(DataFile *df);
+    };
+
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include <pbnj.h>
 #include <DataFile.h>
 
+#include <future>
+#include <list>
 #include <string>
 #include <vector>
 
@@ -14,31 +16,148 @@ namespace pbnj {
     class Volume {
 
         public:
-            //Volume(DataFile *df);
+            // takes ownership of a DataFile that was already loaded, e.g.
+            // on another thread, and needs statistics calculated
+            Volume(DataFile *df, TransferFunction *tf=NULL);
+            // tf may be shared with other volumes, in which case the
+            // volume leaves its range and lifetime to the caller
+            // a downsample factor above 1 loads a smaller copy of the data
+            // that still fills the same space as the full resolution one
+            // a store shares the loaded values with other processes
             Volume(std::string filename, int x, int y, int z,
-                    bool memmap=false);
+                    bool memmap=false, bool prefault=false,
+                    bool approximate=false, TransferFunction *tf=NULL,
+                    unsigned int downsample=1,
+                    DECIMATION decimation=DECIMATE_AVERAGE,
+                    SharedVolumeStore *store=NULL);
             Volume(std::string filename, std::string var_name, int x, int y,
-                    int z, bool memmap=false);
+                    int z, bool memmap=false, bool prefault=false,
+                    bool approximate=false, TransferFunction *tf=NULL,
+                    unsigned int downsample=1,
+                    DECIMATION decimation=DECIMATE_AVERAGE,
+                    SharedVolumeStore *store=NULL);
             ~Volume();
 
+            // (1 - weight) * a + weight * b, e.g. between two timesteps,
+            // which need the same dimensions and quantization, just a if
+            // they don't have them, NULL if even that fails
+            static Volume *createInterpolated(Volume *a, Volume *b,
+                    float weight, TransferFunction *tf=NULL);
+
             void attenuateOpacity(float amount);
             void setColorMap(std::vector<float> &map);
             void setOpacityMap(std::vector<float> &map);
+            // clamp the transfer function range to percentiles (0-100) of
+            // the data so a few outliers don't squash the color map
+            void setRangePercentiles(float low, float high);
+            // {min, max} the transfer function range should cover
+            std::vector<float> getValueRange();
+            void setTransferFunction(TransferFunction *tf);
+            TransferFunction *getTransferFunction();
+            // dimensions of the loaded data, which are smaller than the
+            // file's when it was downsampled
             std::vector<int> getBounds();
+            // voxel (i, j, k) is drawn at origin + spacing * (i, j, k),
+            // with the full resolution data centered on the origin
+            std::vector<float> getGridOrigin();
+            float getGridSpacing();
+            unsigned int getDownsample();
+            // 8 or 16 when the data is held quantized, otherwise 0
+            unsigned int getQuantizedBits();
+            // largest difference quantizing made to any value
+            float getQuantizationError();
+            // data values in the units OSPRay samples the volume in, which
+            // differ from them for quantized data, e.g. for isovalues
+            std::vector<float> toSampleValues(const std::vector<float> &values);
+            Histogram *getHistogram(unsigned int numBins=256);
+            // marching cubes surface of the data, the last few are kept
+            // and owned by the volume
+            TriangleMesh *getIsosurfaceMesh(float isovalue);
+            // min/max of each brick of the data
+            MacrocellGrid *getMacrocells();
+            // bricks that the current opacity map doesn't hide completely
+            std::vector<bool> getVisibleBricks();
+            // {x0, y0, z0, x1, y1, z1} inclusive box around the voxels
+            // the current opacity map shows, empty if there are none
+            std::vector<int> getVisibleBounds();
+            // rays only march through the visible box, kept up to date
+            // with the opacity map by update(), on by default
+            void setCropping(bool crop);
+            // the crop also keeps the bricks these isovalues can pass
+            // through, for isosurfaces found in the volume rather than
+            // extracted as meshes, whatever the opacity map shows
+            // values add up, as several renderers may share the volume
+            void includeIsovalues(const std::vector<float> &values);
+            // the voxel box being rendered, empty if it is all of it
+            std::vector<int> getCropBounds();
             OSPVolume asOSPRayObject();
 
-            std::string ID;
+            // apply any changes that arrived since the last frame
+            // called by the Renderer before rendering
+            void update();
+            // bumped whenever the OSPRay volume is recommitted
+            unsigned long int getVersion();
+            // blends a and b into this volume's values again, in place,
+            // so the OSPRay volume stays the same object and only needs
+            // recommitting, not while a frame is rendering it
+            // a and b must match this volume's dimensions
+            bool interpolate(Volume *a, Volume *b, float weight);
+            // hands the data over to the caller, e.g. to keep it around
+            // once the volume is deleted, nothing else may be called on
+            // the volume afterwards
+            DataFile *releaseDataFile();
+
+            unsigned long int ID;
 
         private:
             DataFile *dataFile;
             TransferFunction *transferFunction;
+            bool ownsTransferFunction;
 
             OSPVolume oVolume;
             OSPData oData;
+            // quantized data gets a copy of the transfer function scaled to
+            // its units
+            OSPTransferFunction oScaledTransferFunction;
+            void attachTransferFunction();
+            unsigned long int version;
+            float gridOrigin[3];
+            float gridSpacing;
+
+            // exact statistics computed in the background when the volume
+            // was set up with estimated ones, the DataFile only takes them
+            // on this thread, statsPending until update() has applied them
+            std::future<DataStatistics> exactStatistics;
+            bool statsPending;
+            // waits for the background pass and hands its result to the
+            // DataFile, without touching OSPRay
+            void finishStatistics();
+
+            float lowPercentile;
+            float highPercentile;
+
+            // most recently used first
+            std::list<TriangleMesh *> meshes;
+
+            bool cropping;
+            // every value passed to includeIsovalues(), empty if low > high
+            float cropIsoLow;
+            float cropIsoHigh;
+            // set when the crop has to be recomputed whatever the opacity
+            // version says, e.g. for a different transfer function
+            bool cropStale;
+            unsigned long int cropOpacityVersion;
+            std::vector<int> cropBounds;
+            void applyCropping();
 
             void init();
+            bool blend(Volume *a, Volume *b, float weight);
+            void applyValueRange();
             void loadFromFile(std::string filename, std::string var_name="",
-                    bool memmap=false);
+                    bool memmap=false, bool prefault=false,
+                    bool approximate=false, unsigned int downsample=1,
+                    DECIMATION decimation=DECIMATE_AVERAGE,
+                    SharedVolumeStore *store=NULL);
     };
 }
 
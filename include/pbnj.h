@@ -3,7 +3,9 @@
 
 #include <ospray/ospray.h>
 
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace pbnj {
     /* contains metadata about the data being requested
@@ -17,12 +19,31 @@ namespace pbnj {
      */
     class DataFile;
 
+    /* value histogram of a DataFile, with bin edges and percentiles */
+    class Histogram;
+
+    /* min/max of each brick of a DataFile, for skipping empty space */
+    class MacrocellGrid;
+
     /* abstraction wrapper around OSPRay volumes */
     class Volume;
 
+    /* marching cubes isosurface of a DataFile as an indexed triangle mesh */
+    class TriangleMesh;
+
     /* abstraction around Volume to hold a series of data volumes */
     class TimeSeries;
 
+    /* per-timestep and per-brick value ranges of a series, saved to disk
+     * so value queries don't need to load any data
+     */
+    class RangeIndex;
+
+    /* volume data shared read-only by the processes on a node through
+     * POSIX shared memory, under one budget for all of them
+     */
+    class SharedVolumeStore;
+
     /* abstraction wrapper around OSPRay transfer functions
      * combines color and opacity tfs into a single object
      */
@@ -31,11 +52,20 @@ namespace pbnj {
     /* abstraction wrapper around OSPRay renderer */
     class Renderer;
 
+    /* OSPRay models shared between renderers, one per volume */
+    class ModelCache;
+
+    /* renderers shared by many sessions and one resident set of volumes */
+    class RendererPool;
+
     /* abstraction wrapper around OSPRay camera
      * Provides simplified camera movement
      */
     class Camera;
 
+    /* orbits and keyframed flythroughs that place a Camera over time */
+    class CameraPath;
+
     /* configuration class, uses rapidjson to parse JSON
      * config files
      */
@@ -43,9 +73,53 @@ namespace pbnj {
 
     class Configuration;
 
+    /* the volume, camera and renderer described by a Configuration,
+     * updated in place as new configurations arrive
+     */
+    class Scene;
+
+    /* renders many configurations, loading each dataset they share once */
+    class BatchRenderer;
+
+    /* small previews of every timestep of a series, and montages of them */
+    class ThumbnailRenderer;
+
+    /* serves rendered frames to clients over a socket */
+    class RenderServer;
+
+    /* the pending requests and metrics of one RenderServer client */
+    class RenderSession;
+
     void pbnjInit(int *argc, const char **argv);
 
-    std::string createID();
+    /* unique, nonzero ID for a PBNJ object, cheap enough to call from
+     * any constructor and safe to call from any thread
+     */
+    unsigned long int createID();
+
+    unsigned int getNumThreads();
+
+    /* what the filesystem says a file is, its device, inode, size and
+     * modification time to the nanosecond, which changes when the file is
+     * rewritten or the path is pointed elsewhere, empty if it's missing
+     */
+    std::string getFileIdentity(std::string filename);
+
+    /* splits [0, count) into one contiguous chunk per thread and calls
+     * func(thread, begin, end) for each chunk, returning when all are done
+     */
+    void parallelFor(long int count,
+            std::function<void(unsigned int, long int, long int)> func);
+
+    /* lossless compression for values held in memory, the bytes of each
+     * elementSize-byte value are split into planes first so that slowly
+     * changing data leaves long runs for the LZ pass to find
+     */
+    void compressBytes(const void *data, size_t bytes,
+            unsigned int elementSize, std::vector<unsigned char> &out);
+    /* false if in is damaged or doesn't hold exactly bytes bytes */
+    bool decompressBytes(const std::vector<unsigned char> &in, void *data,
+            size_t bytes, unsigned int elementSize);
 }
 
 #endif
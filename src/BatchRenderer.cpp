@@ -0,0 +1,374 @@
+#include "BatchRenderer.h"
+#include "Camera.h"
+#include "CameraPath.h"
+#include "ConfigReader.h"
+#include "Configuration.h"
+#include "DataFile.h"
+#include "Renderer.h"
+#include "TransferFunction.h"
+#include "Volume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+
+#include "rapidjson/document.h"
+
+namespace pbnj {
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+BatchRenderer::BatchRenderer() :
+    numDatasets(0), totalTime(0.0), camera(NULL), renderer(NULL)
+{
+    // same default budget as a TimeSeries
+    struct sysinfo systemInfo;
+    sysinfo(&systemInfo);
+    this->maxMemory = systemInfo.mem_unit * systemInfo.freeram * 0.5;
+    // loading is mostly waiting on disk and statistics are already
+    // parallel, so a few loaders are enough to keep the renderer busy
+    this->numWorkers = std::min(getNumThreads(), (unsigned int)4);
+}
+
+BatchRenderer::~BatchRenderer()
+{
+    for(int i = 0; i < this->jobs.size(); i++)
+        delete this->jobs[i].config;
+    delete this->renderer;
+    delete this->camera;
+}
+
+void BatchRenderer::addJob(Configuration *config, std::string name)
+{
+    if(name.empty())
+        name = config->configFilename;
+
+    BatchJob job;
+    job.name = name;
+    job.failed = false;
+    job.waitTime = 0.0;
+    job.loadTime = 0.0;
+    job.renderTime = 0.0;
+
+    // split a time series into single volumes so timesteps shared with
+    // other jobs are only loaded once
+    if(!config->globbedFilenames.empty()) {
+        for(int i = 0; i < config->globbedFilenames.size(); i++) {
+            job.config = new Configuration(*config);
+            job.config->dataFilename = config->globbedFilenames[i];
+            job.config->globbedFilenames.clear();
+            job.config->imageFilename = Renderer::frameFilename(
+                    config->imageFilename, i);
+            job.dataFilename = job.config->dataFilename;
+            job.imageFilename = job.config->imageFilename;
+            this->jobs.push_back(job);
+        }
+        return;
+    }
+
+    job.config = new Configuration(*config);
+    job.dataFilename = config->dataFilename;
+    job.imageFilename = config->imageFilename;
+    this->jobs.push_back(job);
+}
+
+void BatchRenderer::addJobs(std::string path)
+{
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0) {
+        std::cerr << "ERROR: could not find jobs at " << path << std::endl;
+        return;
+    }
+
+    if(S_ISDIR(info.st_mode)) {
+        DIR *directory = opendir(path.c_str());
+        if(directory == NULL) {
+            std::cerr << "ERROR: could not open directory " << path;
+            std::cerr << std::endl;
+            return;
+        }
+        std::vector<std::string> filenames;
+        struct dirent *entry;
+        while((entry = readdir(directory)) != NULL) {
+            std::string name = entry->d_name;
+            if(name.length() > 5 &&
+                    name.compare(name.length() - 5, 5, ".json") == 0)
+                filenames.push_back(path + "/" + name);
+        }
+        closedir(directory);
+
+        // render in a predictable order
+        std::sort(filenames.begin(), filenames.end());
+        for(int i = 0; i < filenames.size(); i++) {
+            Configuration config(filenames[i]);
+            this->addJob(&config, filenames[i]);
+        }
+        return;
+    }
+
+    ConfigReader reader;
+    rapidjson::Document json;
+    reader.parseConfigFile(path, json);
+    if(json.IsArray()) {
+        for(rapidjson::SizeType i = 0; i < json.Size(); i++) {
+            Configuration config(json[i]);
+            config.configFilename = path;
+            this->addJob(&config, path + "[" + std::to_string(i) + "]");
+        }
+    }
+    else {
+        Configuration config(json);
+        config.configFilename = path;
+        this->addJob(&config, path);
+    }
+}
+
+void BatchRenderer::setMaxMemory(unsigned int gigabytes)
+{
+    this->maxMemory = gigabytes * 1073741824L;
+}
+
+void BatchRenderer::setNumWorkers(unsigned int workers)
+{
+    this->numWorkers = std::max(workers, (unsigned int)1);
+}
+
+void BatchRenderer::run()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // everything a dataset's jobs need to load it once
+    struct Dataset {
+        Configuration *config;
+        std::vector<int> jobs;
+        unsigned long int bytes;
+        DataFile *dataFile;
+        double loadTime;
+        // when it was loaded and its jobs were queued for rendering
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // group jobs by dataset in the order they were added
+    std::vector<Dataset> datasets;
+    std::map<std::string, int> datasetIndex;
+    for(int j = 0; j < this->jobs.size(); j++) {
+        Configuration *c = this->jobs[j].config;
+        if(c->getConfigState() != SINGLE_NOVAR &&
+                c->getConfigState() != SINGLE_VAR) {
+            std::cerr << "ERROR: no data for job " << this->jobs[j].name;
+            std::cerr << std::endl;
+            this->jobs[j].failed = true;
+            continue;
+        }
+        // checked up front so the rest of the batch still renders
+        if(Renderer::getFiletype(c->imageFilename) == INVALID) {
+            std::cerr << "ERROR: Invalid image filetype requested for job ";
+            std::cerr << this->jobs[j].name << std::endl;
+            this->jobs[j].failed = true;
+            continue;
+        }
+        std::string key = c->dataFilename + "|" + c->dataVariable + "|" +
+            std::to_string(c->dataXDim) + "x" + std::to_string(c->dataYDim) +
+            "x" + std::to_string(c->dataZDim) + "|" +
+            (c->approximateStats ? "approximate" : "exact") + "|" +
+            std::to_string(c->downsample) +
+            (c->decimation == DECIMATE_STRIDE ? "stride" : "average");
+        if(datasetIndex.count(key) == 0) {
+            datasetIndex[key] = datasets.size();
+            Dataset dataset;
+            dataset.config = c;
+            unsigned long int f = c->downsample;
+            dataset.bytes = ((c->dataXDim + f - 1) / f) *
+                ((c->dataYDim + f - 1) / f) * ((c->dataZDim + f - 1) / f) *
+                sizeof(float);
+            dataset.dataFile = NULL;
+            dataset.loadTime = 0.0;
+            datasets.push_back(dataset);
+        }
+        datasets[datasetIndex[key]].jobs.push_back(j);
+    }
+    this->numDatasets = datasets.size();
+
+    std::mutex lock;
+    std::condition_variable changed;
+    unsigned long int resident = 0;
+    int nextDataset = 0;
+    std::deque<int> loaded;
+
+    // workers load datasets in order while the budget allows, this
+    // thread renders them as they arrive, one after another since every
+    // job shares the one renderer and camera
+    auto loadDatasets = [&]() {
+        while(true) {
+            int d;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if(nextDataset >= datasets.size())
+                    return;
+                d = nextDataset++;
+                // a dataset bigger than the whole budget still gets its
+                // turn once nothing else is resident
+                changed.wait(guard, [&]() {
+                    return resident == 0 ||
+                        resident + datasets[d].bytes <= this->maxMemory;
+                });
+                resident += datasets[d].bytes;
+            }
+
+            auto loadStart = std::chrono::steady_clock::now();
+            Configuration *c = datasets[d].config;
+            DataFile *dataFile = new DataFile(c->dataXDim, c->dataYDim,
+                    c->dataZDim);
+            dataFile->loadFromFile(c->dataFilename, c->dataVariable, false,
+                    false, c->downsample, c->decimation);
+            if(dataFile->data == NULL) {
+                delete dataFile;
+                dataFile = NULL;
+            }
+            else if(c->approximateStats)
+                dataFile->estimateStatistics();
+            else
+                dataFile->calculateStatistics();
+            datasets[d].loadTime = secondsSince(loadStart);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                datasets[d].dataFile = dataFile;
+                datasets[d].queued = std::chrono::steady_clock::now();
+                loaded.push_back(d);
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned int w = 0; w < this->numWorkers; w++)
+        workers.push_back(std::thread(loadDatasets));
+
+    if(this->renderer == NULL)
+        this->renderer = new Renderer();
+
+    for(int done = 0; done < datasets.size(); done++) {
+        int d;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return !loaded.empty(); });
+            d = loaded.front();
+            loaded.pop_front();
+        }
+
+        Dataset &dataset = datasets[d];
+        if(dataset.dataFile == NULL) {
+            std::cerr << "ERROR: could not load " << dataset.config->dataFilename;
+            std::cerr << std::endl;
+            for(int j = 0; j < dataset.jobs.size(); j++)
+                this->jobs[dataset.jobs[j]].failed = true;
+        }
+        else {
+            // the volume owns the data file from here on
+            Volume *volume = new Volume(dataset.dataFile);
+            for(int j = 0; j < dataset.jobs.size(); j++) {
+                BatchJob &job = this->jobs[dataset.jobs[j]];
+                job.loadTime = dataset.loadTime;
+                job.waitTime = secondsSince(dataset.queued);
+                auto renderStart = std::chrono::steady_clock::now();
+                this->renderJob(job, volume);
+                job.renderTime = secondsSince(renderStart);
+            }
+            this->renderer->detachVolume();
+            delete volume;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            resident -= dataset.bytes;
+        }
+        changed.notify_all();
+    }
+
+    for(int w = 0; w < workers.size(); w++)
+        workers[w].join();
+
+    this->totalTime = secondsSince(start);
+}
+
+void BatchRenderer::renderJob(BatchJob &job, Volume *volume)
+{
+    Configuration *c = job.config;
+
+    // an empty map in the configuration means the default one
+    volume->setColorMap(c->colorMap.empty() ? blackToWhite : c->colorMap);
+    volume->setOpacityMap(c->opacityMap.empty() ? ramp : c->opacityMap);
+    volume->attenuateOpacity(c->opacityAttenuation);
+    volume->setRangePercentiles(c->rangeLowPercentile,
+            c->rangeHighPercentile);
+
+    if(this->camera == NULL) {
+        this->camera = new Camera(c->imageWidth, c->imageHeight);
+        this->renderer->setCamera(this->camera);
+    }
+    else if(this->camera->imageWidth != c->imageWidth ||
+            this->camera->imageHeight != c->imageHeight)
+        this->camera->setImageSize(c->imageWidth, c->imageHeight);
+    // a previous job's path may have moved the view point or set a radius
+    this->camera->setPosition(c->cameraX, c->cameraY, c->cameraZ);
+    this->camera->setUpVector(c->cameraUpX, c->cameraUpY, c->cameraUpZ);
+    this->camera->setViewPoint(0.0, 0.0, 0.0);
+    this->camera->setOrbitRadius(0.0);
+
+    this->renderer->setBackgroundColor(c->bgColor);
+    this->renderer->setSamples(c->samples);
+    this->renderer->setIsosurfaceMeshes(c->isosurfaceMeshes);
+    if(c->isosurfaceValues.empty())
+        this->renderer->setVolume(volume);
+    else
+        this->renderer->setIsosurface(volume, c->isosurfaceValues);
+
+    if(c->cameraPathType.empty())
+        this->renderer->renderImage(c->imageFilename);
+    else {
+        CameraPath path(c);
+        this->renderer->renderPath(this->camera, &path, c->cameraPathFrames,
+                c->imageFilename);
+    }
+}
+
+void BatchRenderer::printTimings()
+{
+    // times in seconds, wait is from the dataset being loaded
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "job\timage\tload\twait\trender" << std::endl;
+    int failed = 0;
+    for(int j = 0; j < this->jobs.size(); j++) {
+        BatchJob &job = this->jobs[j];
+        std::cout << job.name << "\t" << job.imageFilename << "\t";
+        if(job.failed) {
+            std::cout << "FAILED" << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << job.loadTime << "\t" << job.waitTime << "\t";
+        std::cout << job.renderTime << std::endl;
+    }
+    std::cout << this->jobs.size() << " jobs (" << failed << " failed) on ";
+    std::cout << this->numDatasets << " datasets in " << this->totalTime;
+    std::cout << " s" << std::endl;
+}
+
+}
@@ -9,13 +9,13 @@ namespace pbnj {
 
 Camera::Camera(int width, int height) :
     imageWidth(width), imageHeight(height), xPos(0.0), yPos(0.0), zPos(0.0),
-    viewX(0.0), viewY(0.0), viewZ(0.0), orbitRadius(0.0)
+    viewX(0.0), viewY(0.0), viewZ(0.0), upX(0.0), upY(1.0), upZ(0.0),
+    orbitRadius(0.0), version(0), committedVersion(0)
 {
     this->ID = createID();
     //setup OSPRay camera with basic parameters
     this->oCamera = ospNewCamera("perspective");
     this->updateOSPRayPosition();
-    ospSetf(this->oCamera, "aspect", (float)this->imageWidth/imageHeight);
     ospCommit(this->oCamera);
 }
 
@@ -26,9 +26,9 @@ Camera::~Camera()
 
 void Camera::setOrbitRadius(float radius)
 {
-    //for use with paths
+    //used by orbit paths that don't set their own radius
     this->orbitRadius = radius;
-    this->updateOSPRayPosition();
+    this->version++;
 }
 
 void Camera::setUpVector(float x, float y, float z)
@@ -36,7 +36,24 @@ void Camera::setUpVector(float x, float y, float z)
     this->upX = x;
     this->upY = y;
     this->upZ = z;    
-    this->updateOSPRayPosition();
+    this->version++;
+}
+
+void Camera::setViewPoint(float x, float y, float z)
+{
+    //the point the camera looks at, the volume's center by default
+    this->viewX = x;
+    this->viewY = y;
+    this->viewZ = z;
+    this->version++;
+}
+
+void Camera::setImageSize(int width, int height)
+{
+    //the Renderer resizes its framebuffer on the next frame
+    this->imageWidth = width;
+    this->imageHeight = height;
+    this->version++;
 }
 
 void Camera::setPosition(float x, float y, float z)
@@ -44,7 +61,7 @@ void Camera::setPosition(float x, float y, float z)
     this->xPos = x;
     this->yPos = y;
     this->zPos = z;
-    this->updateOSPRayPosition();
+    this->version++;
 }
 
 // no longer needed as the volume is centered automatically
@@ -55,6 +72,24 @@ void Camera::centerView()
     this->viewX = 0; //(float)(bounds[0])/2.0;
     this->viewY = 0; //(float)(bounds[1])/2.0;
     this->viewZ = 0; //(float)(bounds[2])/2.0;
+    this->version++;
+}
+
+std::vector<float> Camera::getPosition()
+{
+    std::vector<float> position = {this->xPos, this->yPos, this->zPos};
+    return position;
+}
+
+std::vector<float> Camera::getUpVector()
+{
+    std::vector<float> up = {this->upX, this->upY, this->upZ};
+    return up;
+}
+
+float Camera::getOrbitRadius()
+{
+    return this->orbitRadius;
 }
 
 void Camera::updateOSPRayPosition()
@@ -73,7 +108,22 @@ void Camera::updateOSPRayPosition()
 
     float up[] = {this->upX, this->upY, this->upZ};
     ospSet3fv(this->oCamera, "up",  up);
+
+    ospSetf(this->oCamera, "aspect", (float)this->imageWidth/imageHeight);
+}
+
+void Camera::commit()
+{
+    if(this->version == this->committedVersion)
+        return;
+    this->updateOSPRayPosition();
     ospCommit(this->oCamera);
+    this->committedVersion = this->version;
+}
+
+unsigned long int Camera::getVersion()
+{
+    return this->version;
 }
 
 OSPCamera Camera::asOSPRayObject()
@@ -0,0 +1,235 @@
+#include "CameraPath.h"
+#include "Camera.h"
+#include "Configuration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace pbnj {
+
+static const float PI = 3.14159265;
+
+CameraPath::CameraPath(PATHTYPE type) :
+    type(type), duration(1.0), target(), radius(0.0), revolutions(1.0)
+{
+}
+
+CameraPath::CameraPath(Configuration *config) :
+    type(ORBIT), duration(1.0), target(), radius(0.0), revolutions(1.0)
+{
+    std::string pathType = config->cameraPathType;
+    if(pathType == "orbit")
+        this->type = ORBIT;
+    else if(pathType == "spline")
+        this->type = SPLINE;
+    else if(pathType == "lookAt" || pathType == "look at")
+        this->type = LOOKAT;
+    else
+        std::cerr << "Unrecognized camera path " << pathType
+            << ", using an orbit" << std::endl;
+
+    this->setTarget(config->cameraPathTarget[0], config->cameraPathTarget[1],
+            config->cameraPathTarget[2]);
+    this->setOrbit(config->cameraPathRadius, config->cameraPathRevolutions);
+    if(config->cameraPathDuration > 0.0)
+        this->setDuration(config->cameraPathDuration);
+
+    for(int i = 0; i < config->keyframeTimes.size(); i++) {
+        const float *p = &config->keyframePositions[3*i];
+        const float *v = &config->keyframeViews[3*i];
+        this->addKeyframe(config->keyframeTimes[i], p[0], p[1], p[2],
+                v[0], v[1], v[2]);
+    }
+}
+
+PATHTYPE CameraPath::getType()
+{
+    return this->type;
+}
+
+void CameraPath::setTarget(float x, float y, float z)
+{
+    this->target[0] = x;
+    this->target[1] = y;
+    this->target[2] = z;
+}
+
+void CameraPath::setOrbit(float radius, float revolutions)
+{
+    this->radius = radius;
+    this->revolutions = revolutions;
+}
+
+void CameraPath::setDuration(float seconds)
+{
+    if(seconds <= 0.0) {
+        std::cerr << "Camera path duration must be positive!" << std::endl;
+        return;
+    }
+    this->duration = seconds;
+}
+
+float CameraPath::getDuration()
+{
+    return this->duration;
+}
+
+void CameraPath::addKeyframe(float time, float x, float y, float z)
+{
+    this->addKeyframe(time, x, y, z, this->target[0], this->target[1],
+            this->target[2]);
+}
+
+void CameraPath::addKeyframe(float time, float x, float y, float z,
+        float viewX, float viewY, float viewZ)
+{
+    // insert in time order
+    int index = std::upper_bound(this->keyTimes.begin(), this->keyTimes.end(),
+            time) - this->keyTimes.begin();
+    float position[] = {x, y, z};
+    float view[] = {viewX, viewY, viewZ};
+    this->keyTimes.insert(this->keyTimes.begin() + index, time);
+    this->keyPositions.insert(this->keyPositions.begin() + 3*index,
+            position, position + 3);
+    this->keyViews.insert(this->keyViews.begin() + 3*index, view, view + 3);
+
+    // a keyframed path lasts until its last keyframe
+    if(this->keyTimes.back() > 0.0)
+        this->duration = this->keyTimes.back();
+}
+
+void CameraPath::apply(Camera *camera, float t)
+{
+    if(this->type == ORBIT) {
+        this->applyOrbit(camera, t);
+        return;
+    }
+
+    if(this->keyTimes.empty()) {
+        std::cerr << "Camera path has no keyframes!" << std::endl;
+        return;
+    }
+
+    float position[3];
+    this->interpolate(this->keyPositions, t, position);
+    camera->setPosition(position[0], position[1], position[2]);
+
+    if(this->type == SPLINE) {
+        float view[3];
+        this->interpolate(this->keyViews, t, view);
+        camera->setViewPoint(view[0], view[1], view[2]);
+    }
+    else {
+        camera->setViewPoint(this->target[0], this->target[1],
+                this->target[2]);
+    }
+}
+
+void CameraPath::applyOrbit(Camera *camera, float t)
+{
+    // rotate about the up vector, which the camera keeps
+    std::vector<float> up = camera->getUpVector();
+    float length = std::sqrt(up[0]*up[0] + up[1]*up[1] + up[2]*up[2]);
+    if(length == 0.0) {
+        std::cerr << "Camera up vector is zero, can't orbit!" << std::endl;
+        return;
+    }
+    float axis[3] = {up[0]/length, up[1]/length, up[2]/length};
+
+    float r = this->radius;
+    if(r <= 0.0)
+        r = camera->getOrbitRadius();
+    if(r <= 0.0) {
+        std::vector<float> position = camera->getPosition();
+        float dx = position[0] - this->target[0],
+              dy = position[1] - this->target[1],
+              dz = position[2] - this->target[2];
+        r = std::sqrt(dx*dx + dy*dy + dz*dz);
+    }
+
+    // start from (1,0,0) x up, which is +z for a y-up camera
+    float start[3] = {0.0, -axis[2], axis[1]};
+    float startLength = std::sqrt(start[1]*start[1] + start[2]*start[2]);
+    if(startLength < 1e-6) {
+        // up is along x, use (0,0,1) x up instead
+        start[0] = -axis[1];
+        start[1] = axis[0];
+        start[2] = 0.0;
+        startLength = std::sqrt(start[0]*start[0] + start[1]*start[1]);
+    }
+    for(int i = 0; i < 3; i++)
+        start[i] /= startLength;
+
+    // the start vector is perpendicular to the axis, so rotating it is
+    // start*cos + (axis x start)*sin
+    float angle = 2.0 * PI * this->revolutions * t / this->duration;
+    float side[3] = {axis[1]*start[2] - axis[2]*start[1],
+                     axis[2]*start[0] - axis[0]*start[2],
+                     axis[0]*start[1] - axis[1]*start[0]};
+    float c = std::cos(angle), s = std::sin(angle);
+    camera->setPosition(this->target[0] + r*(start[0]*c + side[0]*s),
+                        this->target[1] + r*(start[1]*c + side[1]*s),
+                        this->target[2] + r*(start[2]*c + side[2]*s));
+    camera->setViewPoint(this->target[0], this->target[1], this->target[2]);
+}
+
+void CameraPath::interpolate(std::vector<float> &points, float t,
+        float *result)
+{
+    // Catmull-Rom spline through the keyframes, the end keyframes are
+    // repeated so the curve passes through all of them
+    int count = this->keyTimes.size();
+    if(count == 1 || t <= this->keyTimes.front()) {
+        std::copy(points.begin(), points.begin() + 3, result);
+        return;
+    }
+    if(t >= this->keyTimes.back()) {
+        std::copy(points.end() - 3, points.end(), result);
+        return;
+    }
+
+    int segment = std::upper_bound(this->keyTimes.begin(),
+            this->keyTimes.end(), t) - this->keyTimes.begin() - 1;
+    float span = this->keyTimes[segment+1] - this->keyTimes[segment];
+    float u = span > 0.0 ? (t - this->keyTimes[segment]) / span : 0.0;
+    float u2 = u*u, u3 = u2*u;
+
+    int i0 = std::max(segment - 1, 0);
+    int i1 = segment;
+    int i2 = segment + 1;
+    int i3 = std::min(segment + 2, count - 1);
+    for(int d = 0; d < 3; d++) {
+        float p0 = points[3*i0 + d], p1 = points[3*i1 + d],
+              p2 = points[3*i2 + d], p3 = points[3*i3 + d];
+        result[d] = 0.5 * ((2*p1) + (-p0 + p2)*u +
+                (2*p0 - 5*p1 + 4*p2 - p3)*u2 + (-p0 + 3*p1 - 3*p2 + p3)*u3);
+    }
+}
+
+std::vector<float> CameraPath::getFrameTimes(unsigned int numFrames)
+{
+    std::vector<float> times;
+    if(numFrames == 0)
+        return times;
+
+    float start = 0.0;
+    if(this->type != ORBIT && !this->keyTimes.empty())
+        start = this->keyTimes.front();
+    float length = this->duration - start;
+
+    // an orbit ends where it started, so don't render that frame twice
+    unsigned int intervals = numFrames - 1;
+    if(this->type == ORBIT)
+        intervals = numFrames;
+    for(unsigned int i = 0; i < numFrames; i++) {
+        if(intervals == 0)
+            times.push_back(start);
+        else
+            times.push_back(start + length * i / intervals);
+    }
+    return times;
+}
+
+}
@@ -4,6 +4,12 @@
 
 namespace pbnj {
 
+// the transfer function's default
+std::vector<float> blackToWhite = {
+    0.0, 0.0, 0.0,
+    1.0, 1.0, 1.0
+};
+
 std::vector<float> coolToWarm = {
     0.2298057, 0.2987180, 0.7536832,
     0.2342999, 0.3055592, 0.7598748,
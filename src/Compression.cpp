@@ -0,0 +1,209 @@
+#include "pbnj.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace pbnj {
+
+// the first byte of a compressed buffer says how the rest is stored
+static const unsigned char STORED_RAW = 0;
+static const unsigned char STORED_LZ = 1;
+
+static const unsigned int MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 14;
+
+static void shuffle(const unsigned char *in, size_t bytes,
+        unsigned int elementSize, unsigned char *out)
+{
+    // byte b of every value goes to plane b, any partial value at the end
+    // is copied as it is
+    size_t count = bytes / elementSize;
+    for(unsigned int b = 0; b < elementSize; b++) {
+        unsigned char *plane = out + b*count;
+        for(size_t i = 0; i < count; i++)
+            plane[i] = in[i*elementSize + b];
+    }
+    memcpy(out + count*elementSize, in + count*elementSize,
+            bytes - count*elementSize);
+}
+
+static void unshuffle(const unsigned char *in, size_t bytes,
+        unsigned int elementSize, unsigned char *out)
+{
+    size_t count = bytes / elementSize;
+    for(unsigned int b = 0; b < elementSize; b++) {
+        const unsigned char *plane = in + b*count;
+        for(size_t i = 0; i < count; i++)
+            out[i*elementSize + b] = plane[i];
+    }
+    memcpy(out + count*elementSize, in + count*elementSize,
+            bytes - count*elementSize);
+}
+
+// lengths past what fits in a token nibble continue in bytes of 255 and a
+// final byte below that
+static void writeLength(size_t length, std::vector<unsigned char> &out)
+{
+    while(length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((unsigned char)length);
+}
+
+static bool readLength(const unsigned char *in, size_t size, size_t &pos,
+        size_t &length)
+{
+    unsigned char byte;
+    do {
+        if(pos >= size)
+            return false;
+        byte = in[pos++];
+        length += byte;
+    } while(byte == 255);
+    return true;
+}
+
+// one sequence is a token byte with the literal count in the high nibble
+// and the match length (less MIN_MATCH) in the low one, the literals, then
+// a two byte little endian offset back to the match
+// the last sequence is only literals
+static void writeSequence(const unsigned char *literals, size_t numLiterals,
+        size_t offset, size_t matchLength, std::vector<unsigned char> &out)
+{
+    size_t extra = matchLength - MIN_MATCH;
+    unsigned char token = (numLiterals < 15 ? numLiterals : 15) << 4;
+    if(matchLength > 0)
+        token |= extra < 15 ? extra : 15;
+    out.push_back(token);
+    if(numLiterals >= 15)
+        writeLength(numLiterals - 15, out);
+    out.insert(out.end(), literals, literals + numLiterals);
+    if(matchLength == 0)
+        return;
+    out.push_back(offset & 0xff);
+    out.push_back(offset >> 8);
+    if(extra >= 15)
+        writeLength(extra - 15, out);
+}
+
+static void lzCompress(const unsigned char *in, size_t size,
+        std::vector<unsigned char> &out)
+{
+    // positions of recent 4 byte sequences, by hash
+    std::vector<int64_t> table(1 << HASH_BITS, -1);
+    size_t anchor = 0;
+    size_t i = 0;
+    while(i + MIN_MATCH <= size) {
+        uint32_t sequence;
+        memcpy(&sequence, in + i, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        int64_t candidate = table[hash];
+        table[hash] = i;
+
+        if(candidate < 0 || i - candidate > MAX_OFFSET ||
+                memcmp(in + candidate, in + i, MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while(i + length < size && in[candidate + length] == in[i + length])
+            length++;
+        writeSequence(in + anchor, i - anchor, i - candidate, length, out);
+        i += length;
+        anchor = i;
+    }
+    writeSequence(in + anchor, size - anchor, 0, 0, out);
+}
+
+static bool lzDecompress(const unsigned char *in, size_t size,
+        unsigned char *out, size_t bytes)
+{
+    size_t pos = 0;
+    size_t written = 0;
+    while(pos < size) {
+        unsigned char token = in[pos++];
+
+        size_t numLiterals = token >> 4;
+        if(numLiterals == 15 && !readLength(in, size, pos, numLiterals))
+            return false;
+        if(numLiterals > size - pos || numLiterals > bytes - written)
+            return false;
+        memcpy(out + written, in + pos, numLiterals);
+        pos += numLiterals;
+        written += numLiterals;
+        if(pos == size)
+            break;
+
+        if(pos + 2 > size)
+            return false;
+        size_t offset = in[pos] | (in[pos + 1] << 8);
+        pos += 2;
+        size_t length = token & 15;
+        if(length == 15 && !readLength(in, size, pos, length))
+            return false;
+        length += MIN_MATCH;
+        if(offset == 0 || offset > written || length > bytes - written)
+            return false;
+        // matches may overlap what they write, so copy a byte at a time
+        unsigned char *match = out + written - offset;
+        for(size_t b = 0; b < length; b++)
+            out[written + b] = match[b];
+        written += length;
+    }
+    return written == bytes;
+}
+
+void compressBytes(const void *data, size_t bytes, unsigned int elementSize,
+        std::vector<unsigned char> &out)
+{
+    std::vector<unsigned char> shuffled(bytes);
+    if(elementSize > 1)
+        shuffle((const unsigned char *)data, bytes, elementSize,
+                shuffled.data());
+    else
+        memcpy(shuffled.data(), data, bytes);
+
+    out.clear();
+    out.push_back(STORED_LZ);
+    lzCompress(shuffled.data(), bytes, out);
+    // data that doesn't compress is kept as it is
+    if(out.size() > bytes + 1) {
+        out.assign(1, STORED_RAW);
+        out.insert(out.end(), shuffled.begin(), shuffled.end());
+    }
+    out.shrink_to_fit();
+}
+
+bool decompressBytes(const std::vector<unsigned char> &in, void *data,
+        size_t bytes, unsigned int elementSize)
+{
+    if(in.empty())
+        return false;
+    std::vector<unsigned char> shuffled;
+    unsigned char *target = (unsigned char *)data;
+    if(elementSize > 1) {
+        shuffled.resize(bytes);
+        target = shuffled.data();
+    }
+
+    if(in[0] == STORED_RAW) {
+        if(in.size() != bytes + 1)
+            return false;
+        memcpy(target, in.data() + 1, bytes);
+    }
+    else if(in[0] != STORED_LZ ||
+            !lzDecompress(in.data() + 1, in.size() - 1, target, bytes))
+        return false;
+
+    if(elementSize > 1)
+        unshuffle(shuffled.data(), bytes, elementSize,
+                (unsigned char *)data);
+    return true;
+}
+
+}
@@ -1,7 +1,9 @@
 #include "ConfigReader.h"
 
 #include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
 
+#include <iostream>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -16,6 +18,12 @@ void ConfigReader::parseConfigFile(std::string filename,
 {
     //open file and get its length
     FILE *file = fopen(filename.c_str(), "r");
+    if(file == NULL) {
+        std::cerr << "ERROR: could not open config file " << filename;
+        std::cerr << std::endl;
+        config.SetObject();
+        return;
+    }
     fseek(file, 0, SEEK_END);
     long fileLength = ftell(file);
     fseek(file, 0, SEEK_SET);
@@ -26,8 +34,29 @@ void ConfigReader::parseConfigFile(std::string filename,
     fclose(file);
     json[fileLength] = 0;
 
-    //parse the string in place
-    config.ParseInsitu(json);
+    //parse a copy so the buffer can go, configs may be reloaded many
+    //times over in a long running process
+    this->parseConfigString(json, config);
+    free(json);
+}
+
+void ConfigReader::parseConfigString(std::string text,
+        rapidjson::Document& config)
+{
+    config.Parse(text.c_str());
+    if(config.HasParseError()) {
+        std::cerr << "ERROR: could not parse config at offset ";
+        std::cerr << config.GetErrorOffset() << ": ";
+        std::cerr << rapidjson::GetParseError_En(config.GetParseError());
+        std::cerr << std::endl;
+        //leave an empty config so every required member reads as missing
+        config.SetObject();
+    }
+    else if(!config.IsObject() && !config.IsArray()) {
+        //arrays are allowed for lists of configs
+        std::cerr << "ERROR: config is not a JSON object" << std::endl;
+        config.SetObject();
+    }
 }
 
 }
@@ -4,6 +4,7 @@
 
 #include "rapidjson/document.h"
 
+#include <algorithm>
 #include <glob.h>
 #include <iostream>
 
@@ -13,9 +14,133 @@ Configuration::Configuration(std::string filename) :
     configFilename(filename)
 {
     //get a parsed json document from the file
-    this->reader = new ConfigReader();
+    ConfigReader reader;
     rapidjson::Document json;
-    this->reader->parseConfigFile(filename, json);
+    reader.parseConfigFile(filename, json);
+    this->parse(json);
+}
+
+Configuration::Configuration(const rapidjson::Value& json)
+{
+    this->parse(json);
+}
+
+// count 0 allows any length
+static bool isNumbers(const rapidjson::Value& value, unsigned int count)
+{
+    if(!value.IsArray() || (count != 0 && value.Size() != count))
+        return false;
+    for(rapidjson::SizeType i = 0; i < value.Size(); i++)
+        if(!value[i].IsNumber())
+            return false;
+    return true;
+}
+
+static bool isInts(const rapidjson::Value& value, unsigned int count,
+        bool isUnsigned)
+{
+    if(!value.IsArray() || value.Size() != count)
+        return false;
+    for(rapidjson::SizeType i = 0; i < value.Size(); i++)
+        if(!(isUnsigned ? value[i].IsUint() : value[i].IsInt()))
+            return false;
+    return true;
+}
+
+static std::string checkCameraPath(const rapidjson::Value& path)
+{
+    if(!path.IsObject())
+        return "cameraPath must be an object";
+    if(path.HasMember("type") && !path["type"].IsString())
+        return "cameraPath type must be a string";
+    if(path.HasMember("frames") && !path["frames"].IsUint())
+        return "cameraPath frames must be a non-negative integer";
+    const char *numbers[] = {"duration", "radius", "revolutions"};
+    for(int n = 0; n < 3; n++)
+        if(path.HasMember(numbers[n]) && !path[numbers[n]].IsNumber())
+            return std::string("cameraPath ") + numbers[n] +
+                " must be a number";
+    if(path.HasMember("target") && !isNumbers(path["target"], 3))
+        return "cameraPath target must be an array of 3 numbers";
+    if(path.HasMember("keyframes")) {
+        const rapidjson::Value& keys = path["keyframes"];
+        if(!keys.IsArray())
+            return "cameraPath keyframes must be an array";
+        for(rapidjson::SizeType k = 0; k < keys.Size(); k++) {
+            const rapidjson::Value& key = keys[k];
+            if(!key.IsObject() || !key.HasMember("position") ||
+                    !isNumbers(key["position"], 3) ||
+                    (key.HasMember("time") && !key["time"].IsNumber()) ||
+                    (key.HasMember("viewPoint") &&
+                     !isNumbers(key["viewPoint"], 3)))
+                return "cameraPath keyframes need a position of 3 numbers";
+        }
+    }
+    return "";
+}
+
+std::string Configuration::checkSetting(std::string name,
+        const rapidjson::Value& value)
+{
+    // the same types parse() reads each setting as
+    if(name == "filename" || name == "outputImageFilename" ||
+            name == "downsampleFilter" || name == "dataVariable" ||
+            name == "colorMap") {
+        if(!value.IsString())
+            return name + " must be a string";
+    }
+    else if(name == "approximateStatistics" ||
+            name == "isosurfaceMeshes") {
+        if(!value.IsBool())
+            return name + " must be true or false";
+    }
+    else if(name == "downsample" || name == "quantize" ||
+            name == "sharedMemory" || name == "samplesPerPixel") {
+        if(!value.IsUint())
+            return name + " must be a non-negative integer";
+    }
+    else if(name == "opacityAttenuation") {
+        if(!value.IsNumber())
+            return name + " must be a number";
+    }
+    else if(name == "dimensions") {
+        if(!isInts(value, 3, false))
+            return name + " must be an array of 3 integers";
+    }
+    else if(name == "imageSize") {
+        if(!isInts(value, 2, false))
+            return name + " must be an array of 2 integers";
+    }
+    else if(name == "backgroundColor") {
+        if(!isInts(value, 3, true))
+            return name + " must be an array of 3 non-negative integers";
+    }
+    else if(name == "valueRangePercentiles" || name == "valueRange") {
+        if(!isNumbers(value, 2))
+            return name + " must be an array of 2 numbers";
+    }
+    else if(name == "cameraPosition" || name == "cameraUpVector") {
+        if(!isNumbers(value, 3))
+            return name + " must be an array of 3 numbers";
+    }
+    else if(name == "opacityMap") {
+        if(!value.IsString() && !isNumbers(value, 0))
+            return name + " must be a name or an array of numbers";
+    }
+    else if(name == "isosurfaceValues") {
+        if(!value.IsNumber() && !isNumbers(value, 0))
+            return name + " must be a number or an array of numbers";
+    }
+    else if(name == "cameraPath")
+        return checkCameraPath(value);
+    return "";
+}
+
+void Configuration::parse(const rapidjson::Value& json)
+{
+    // keep missing required values comparable in diff()
+    this->dataXDim = this->dataYDim = this->dataZDim = 0;
+    this->imageWidth = this->imageHeight = 0;
 
     /* the following are required:
      *  - data filename
@@ -104,6 +229,40 @@ Configuration::Configuration(std::string filename) :
             this->bgColor.push_back((unsigned char)bg[i].GetUint());
     }
 
+    // estimate statistics from a subsample so the first frame renders
+    // sooner, exact statistics follow in the background
+    if(json.HasMember("approximateStatistics"))
+        this->approximateStats = json["approximateStatistics"].GetBool();
+    else
+        this->approximateStats = false;
+
+    // load one value per factor^3 box of voxels, averaged by default or
+    // the first of each box with "stride", to cut loading time and memory
+    this->downsample = 1;
+    if(json.HasMember("downsample"))
+        this->downsample = std::max(json["downsample"].GetUint(), 1u);
+    this->decimation = DECIMATE_AVERAGE;
+    if(json.HasMember("downsampleFilter")) {
+        std::string filter = json["downsampleFilter"].GetString();
+        if(filter == "stride")
+            this->decimation = DECIMATE_STRIDE;
+        else if(filter != "average")
+            std::cerr << "WARNING: unknown downsample filter " << filter
+                << ", averaging instead" << std::endl;
+    }
+
+    // time series can hold their volumes as 8 or 16 bit values to keep
+    // more of them in memory
+    this->quantizeBits = 0;
+    if(json.HasMember("quantize"))
+        this->quantizeBits = json["quantize"].GetUint();
+
+    // processes rendering the same data on one node, e.g. several servers,
+    // can load it once into shared memory and map it from there
+    this->sharedMemory = 0;
+    if(json.HasMember("sharedMemory"))
+        this->sharedMemory = json["sharedMemory"].GetUint();
+
     // choice of variable for netcdf files
     if(json.HasMember("dataVariable"))
         this->dataVariable = json["dataVariable"].GetString();
@@ -132,6 +291,26 @@ Configuration::Configuration(std::string filename) :
     else
         this->opacityAttenuation = 1.0;
 
+    // clamp the transfer function range to these percentiles of the data
+    // e.g. [0.5, 99.5], the default is the full range
+    if(json.HasMember("valueRangePercentiles")) {
+        const rapidjson::Value& percentiles = json["valueRangePercentiles"];
+        this->rangeLowPercentile = percentiles[0].GetFloat();
+        this->rangeHighPercentile = percentiles[1].GetFloat();
+    }
+    else {
+        this->rangeLowPercentile = 0.0;
+        this->rangeHighPercentile = 100.0;
+    }
+
+    // or color every volume over the same values, e.g. a whole series
+    this->valueRange.clear();
+    if(json.HasMember("valueRange")) {
+        const rapidjson::Value& range = json["valueRange"];
+        this->valueRange.push_back(range[0].GetFloat());
+        this->valueRange.push_back(range[1].GetFloat());
+    }
+
     // samples per pixel
     if(json.HasMember("samplesPerPixel")) {
         unsigned int val = json["samplesPerPixel"].GetUint();
@@ -167,6 +346,60 @@ Configuration::Configuration(std::string filename) :
         this->cameraUpZ = 0.0;
     }
 
+    // an optional camera path, e.g.
+    //  {"type": "orbit", "frames": 120, "radius": 500, "revolutions": 1}
+    //  {"type": "spline", "frames": 240, "keyframes": [
+    //      {"time": 0, "position": [0, 0, 512], "viewPoint": [0, 0, 0]},
+    //      ...]}
+    // "lookAt" paths take keyframe positions and always face "target"
+    this->cameraPathFrames = 0;
+    this->cameraPathDuration = 0.0;
+    this->cameraPathRadius = 0.0;
+    this->cameraPathRevolutions = 1.0;
+    this->cameraPathTarget = {0.0, 0.0, 0.0};
+    if(json.HasMember("cameraPath")) {
+        const rapidjson::Value& path = json["cameraPath"];
+        if(path.HasMember("type"))
+            this->cameraPathType = path["type"].GetString();
+        else
+            this->cameraPathType = "orbit";
+        if(path.HasMember("frames"))
+            this->cameraPathFrames = path["frames"].GetUint();
+        else
+            this->cameraPathFrames = 60;
+        if(path.HasMember("duration"))
+            this->cameraPathDuration = path["duration"].GetFloat();
+        if(path.HasMember("radius"))
+            this->cameraPathRadius = path["radius"].GetFloat();
+        if(path.HasMember("revolutions"))
+            this->cameraPathRevolutions = path["revolutions"].GetFloat();
+        if(path.HasMember("target")) {
+            const rapidjson::Value& target = path["target"];
+            for(rapidjson::SizeType i = 0; i < 3; i++)
+                this->cameraPathTarget[i] = target[i].GetFloat();
+        }
+        if(path.HasMember("keyframes")) {
+            const rapidjson::Value& keys = path["keyframes"];
+            for(rapidjson::SizeType k = 0; k < keys.Size(); k++) {
+                const rapidjson::Value& key = keys[k];
+                if(key.HasMember("time"))
+                    this->keyframeTimes.push_back(key["time"].GetFloat());
+                else
+                    this->keyframeTimes.push_back((float)k);
+                for(rapidjson::SizeType i = 0; i < 3; i++) {
+                    this->keyframePositions.push_back(
+                            key["position"][i].GetFloat());
+                    if(key.HasMember("viewPoint"))
+                        this->keyframeViews.push_back(
+                                key["viewPoint"][i].GetFloat());
+                    else
+                        this->keyframeViews.push_back(
+                                this->cameraPathTarget[i]);
+                }
+            }
+        }
+    }
+
     // isosurface values for rendering surfaces instead of volume rendering
     // if this is not present, the vector is empty and a volume is rendered
     if(json.HasMember("isosurfaceValues")) {
@@ -181,6 +414,13 @@ Configuration::Configuration(std::string filename) :
                     json["isosurfaceValues"].GetFloat());
         }
     }
+
+    // extract the isosurfaces as triangle meshes rather than intersecting
+    // the volume, worth it when the values don't change from frame to frame
+    if(json.HasMember("isosurfaceMeshes"))
+        this->isosurfaceMeshes = json["isosurfaceMeshes"].GetBool();
+    else
+        this->isosurfaceMeshes = false;
 }
 
 void Configuration::selectColorMap(std::string userInput)
@@ -245,6 +485,87 @@ void Configuration::selectOpacityMap(std::string userInput)
     }
 }
 
+unsigned int Configuration::diff(Configuration *other)
+{
+    unsigned int changes = CHANGE_NONE;
+
+    // the filenames themselves are left to getDataIdentity(), another
+    // path to the same file needs no reload
+    if(this->getConfigState() != other->getConfigState() ||
+            this->dataVariable != other->dataVariable ||
+            this->dataXDim != other->dataXDim ||
+            this->dataYDim != other->dataYDim ||
+            this->dataZDim != other->dataZDim ||
+            this->approximateStats != other->approximateStats ||
+            this->downsample != other->downsample ||
+            this->decimation != other->decimation ||
+            this->quantizeBits != other->quantizeBits ||
+            this->sharedMemory != other->sharedMemory)
+        changes |= CHANGE_DATA;
+
+    if(this->colorMap != other->colorMap ||
+            this->opacityMap != other->opacityMap ||
+            this->opacityAttenuation != other->opacityAttenuation)
+        changes |= CHANGE_TRANSFERFUNCTION;
+
+    if(this->rangeLowPercentile != other->rangeLowPercentile ||
+            this->rangeHighPercentile != other->rangeHighPercentile ||
+            this->valueRange != other->valueRange)
+        changes |= CHANGE_RANGE;
+
+    if(this->imageWidth != other->imageWidth ||
+            this->imageHeight != other->imageHeight ||
+            this->cameraX != other->cameraX ||
+            this->cameraY != other->cameraY ||
+            this->cameraZ != other->cameraZ ||
+            this->cameraUpX != other->cameraUpX ||
+            this->cameraUpY != other->cameraUpY ||
+            this->cameraUpZ != other->cameraUpZ)
+        changes |= CHANGE_CAMERA;
+
+    if(this->cameraPathType != other->cameraPathType ||
+            this->cameraPathFrames != other->cameraPathFrames ||
+            this->cameraPathDuration != other->cameraPathDuration ||
+            this->cameraPathRadius != other->cameraPathRadius ||
+            this->cameraPathRevolutions != other->cameraPathRevolutions ||
+            this->cameraPathTarget != other->cameraPathTarget ||
+            this->keyframeTimes != other->keyframeTimes ||
+            this->keyframePositions != other->keyframePositions ||
+            this->keyframeViews != other->keyframeViews)
+        changes |= CHANGE_CAMERAPATH;
+
+    if(this->bgColor != other->bgColor ||
+            this->samples != other->samples ||
+            this->isosurfaceValues != other->isosurfaceValues ||
+            this->isosurfaceMeshes != other->isosurfaceMeshes)
+        changes |= CHANGE_RENDERER;
+
+    if(this->imageFilename != other->imageFilename)
+        changes |= CHANGE_OUTPUT;
+
+    return changes;
+}
+
+std::string Configuration::getDataIdentity()
+{
+    // the same path can hold a different file after a rewrite, and a
+    // different path can lead to the same file, so identify the data by
+    // what the filesystem says rather than by name
+    std::vector<std::string> filenames = this->globbedFilenames;
+    if(!this->dataFilename.empty())
+        filenames.push_back(this->dataFilename);
+
+    std::string identity;
+    for(int i = 0; i < filenames.size(); i++) {
+        std::string file = getFileIdentity(filenames[i]);
+        // nothing to compare with, so a missing file always differs
+        if(file.empty())
+            file = filenames[i] + ":missing";
+        identity += file + ";";
+    }
+    return identity;
+}
+
 CONFSTATE Configuration::getConfigState()
 {
     // six possible states for the config/data
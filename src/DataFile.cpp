@@ -1,14 +1,21 @@
 #include "DataFile.h"
+#include "Histogram.h"
+#include "MacrocellGrid.h"
+#include "SharedVolumeStore.h"
 
 #include <cmath>
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <algorithm>
 
@@ -19,60 +26,185 @@
 
 namespace pbnj {
 
+// transparent huge pages are 2MB on x86_64
+static const size_t HUGE_PAGE_SIZE = 2*1024*1024;
+
+// compressed independently so threads can share the work
+static const size_t COMPRESSION_BLOCK_SIZE = 1024*1024;
+
+// only the calling thread's, so other threads loading or rendering at the
+// same time aren't counted, parallel passes add up their threads' counts
+static void getPageFaults(long &minor, long &major)
+{
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    minor = usage.ru_minflt;
+    major = usage.ru_majflt;
+}
+
+#ifdef PBNJ_NETCDF
+static netCDF::NcVar getVariable(netCDF::NcFile &dataFile,
+        std::string var_name)
+{
+    if(var_name.compare("") == 0) {
+        // only get the first variable
+        const std::multimap<std::string, netCDF::NcVar> varmap =
+            dataFile.getVars();
+        return varmap.begin()->second;
+    }
+    return dataFile.getVar(var_name);
+}
+#endif
+
+// averages each factor^3 box of a slab of depth <= factor z slices down to
+// one slice of the downsampled data
+static void averageSlab(const float *slab, int x, int y, int depth,
+        unsigned int factor, float *out)
+{
+    int outX = (x + factor - 1) / factor;
+    int outY = (y + factor - 1) / factor;
+    std::fill(out, out + (long int)outX * outY, 0.0f);
+
+    for(int k = 0; k < depth; k++) {
+        for(int j = 0; j < y; j++) {
+            const float *row = slab + ((long int)k * y + j) * x;
+            float *outRow = out + (long int)(j / factor) * outX;
+            for(int i = 0; i < x; i++)
+                outRow[i / factor] += row[i];
+        }
+    }
+
+    // boxes on the far edges are cut short by the data
+    for(int j = 0; j < outY; j++) {
+        int height = std::min((int)factor, y - j * (int)factor);
+        for(int i = 0; i < outX; i++) {
+            int width = std::min((int)factor, x - i * (int)factor);
+            out[(long int)j * outX + i] /= (float)(depth * height * width);
+        }
+    }
+}
+
 DataFile::DataFile(int x, int y, int z) :
-    xDim(x), yDim(y), zDim(z), numValues(x*y*z), statsCalculated(false)
+    xDim(x), yDim(y), zDim(z), numValues(x*y*z), downsample(1),
+    decimation(DECIMATE_AVERAGE), fileXDim(x), fileYDim(y), fileZDim(z),
+    data(NULL), quantizedBits(0), quantizedData(NULL), quantizeOffset(0.0),
+    quantizeScale(1.0), quantizeError(0.0), statsCalculated(false),
+    statsApproximate(false), minorFaults(0), majorFaults(0),
+    compressed(false), wasMemoryMapped(false), sharedStore(NULL),
+    wasShared(false), histogram(NULL), macrocells(NULL)
 {
 }
 
 DataFile::~DataFile()
 {
-    if(this->data != NULL) {
-        if(this->wasMemoryMapped) {
-            int mresult = munmap(this->data, this->numValues*sizeof(float));
-            if(mresult == -1)
-                std::cerr << "WARNING: Couldn't unmap data!" << std::endl;
-        }
-        else
-            free(this->data);
-        this->data = NULL;
+    delete this->histogram;
+    this->histogram = NULL;
+    delete this->macrocells;
+    this->macrocells = NULL;
+    this->freeData();
+    free(this->quantizedData);
+    this->quantizedData = NULL;
+}
+
+void DataFile::freeData()
+{
+    if(this->data == NULL)
+        return;
+    if(this->wasShared)
+        this->sharedStore->release(this->data);
+    else if(this->wasMemoryMapped) {
+        int mresult = munmap(this->data, this->numValues*sizeof(float));
+        if(mresult == -1)
+            std::cerr << "WARNING: Couldn't unmap data!" << std::endl;
     }
+    else
+        free(this->data);
+    this->data = NULL;
+    this->wasMemoryMapped = false;
+    this->wasShared = false;
+}
+
+void DataFile::setSharedStore(SharedVolumeStore *store)
+{
+    this->sharedStore = store;
+}
+
+bool DataFile::isShared()
+{
+    return this->wasShared;
 }
 
 void DataFile::loadFromFile(std::string filename, std::string var_name,
-        bool memmap)
+        bool memmap, bool prefault, unsigned int factor,
+        DECIMATION decimation)
 {
+    long minorStart, majorStart;
+    getPageFaults(minorStart, majorStart);
+
     //check if the filetype is known
     this->filename = filename;
     this->filetype = getFiletype();
+    if(factor == 0)
+        factor = 1;
+    this->downsample = factor;
+    this->decimation = decimation;
 
+    bool mapsFile = this->filetype == BINARY && memmap && factor == 1;
     if(this->filetype == UNKNOWN) {
         std::cerr << "Unknown filetype!" << std::endl;
     }
+    else if(this->sharedStore != NULL && !mapsFile &&
+            this->loadShared(var_name)) {
+        // another process may have done the reading
+    }
     else if(this->filetype == NETCDF) {
 #ifdef PBNJ_NETCDF
         // no explicit close needed, destructor calls it
         netCDF::NcFile dataFile(filename.c_str(), netCDF::NcFile::read);
-
-        netCDF::NcVar variable;
-        if(var_name.compare("") == 0) {
-            // only get the first variable
-            const std::multimap<std::string, netCDF::NcVar> varmap = 
-                dataFile.getVars();
-            variable = varmap.begin()->second;
-        }
-        else {
-            variable = dataFile.getVar(var_name);
-        }
+        netCDF::NcVar variable = getVariable(dataFile, var_name);
 
         // overwrite any configured values with the file's values
-        this->xDim = (int) variable.getDim(2).getSize();
-        this->yDim = (int) variable.getDim(1).getSize();
-        this->zDim = (int) variable.getDim(0).getSize();
-        this->numValues = this->xDim * this->yDim * this->zDim;
+        int x = (int) variable.getDim(2).getSize();
+        int y = (int) variable.getDim(1).getSize();
+        int z = (int) variable.getDim(0).getSize();
+        this->fileXDim = x;
+        this->fileYDim = y;
+        this->fileZDim = z;
+        this->xDim = (x + factor - 1) / factor;
+        this->yDim = (y + factor - 1) / factor;
+        this->zDim = (z + factor - 1) / factor;
+        this->numValues = (long int)this->xDim * this->yDim * this->zDim;
 
         // load data
-        this->data = (float *)malloc(this->numValues * sizeof(float));
-        variable.getVar(this->data);
+        this->data = this->allocateData();
+        if(factor == 1) {
+            variable.getVar(this->data);
+        }
+        else if(decimation == DECIMATE_STRIDE) {
+            // the library only reads the sampled values
+            std::vector<size_t> start(3, 0);
+            std::vector<size_t> count = {(size_t)this->zDim,
+                (size_t)this->yDim, (size_t)this->xDim};
+            std::vector<ptrdiff_t> stride(3, factor);
+            variable.getVar(start, count, stride, this->data);
+        }
+        else {
+            // one slab of factor slices at a time
+            std::vector<float> slab((size_t)factor * x * y);
+            for(int k = 0; k < this->zDim; k++) {
+                int depth = std::min((int)factor, z - k * (int)factor);
+                std::vector<size_t> start = {(size_t)k * factor, 0, 0};
+                std::vector<size_t> count = {(size_t)depth, (size_t)y,
+                    (size_t)x};
+                variable.getVar(start, count, slab.data());
+                averageSlab(slab.data(), x, y, depth, factor,
+                        this->data + (long int)k * this->xDim * this->yDim);
+            }
+        }
 #else
         std::cerr << "PBNJ was not built with NetCDF support!" << std::endl;
 #endif
@@ -84,20 +216,217 @@ void DataFile::loadFromFile(std::string filename, std::string var_name,
             std::cerr << "Could not open file!" << std::endl;
         }
         else {
-            if(memmap) {
+            if(factor > 1) {
+                int x = this->fileXDim, y = this->fileYDim;
+                int z = this->fileZDim;
+                this->xDim = (x + factor - 1) / factor;
+                this->yDim = (y + factor - 1) / factor;
+                this->zDim = (z + factor - 1) / factor;
+                this->numValues = (long int)this->xDim * this->yDim *
+                    this->zDim;
+                this->data = this->allocateData();
+                this->readDecimated(dataFile, x, y, z);
+            }
+            else if(memmap) {
                 int fd = fileno(dataFile);
-                this->data = (float *)mmap(NULL, this->numValues*sizeof(float),
-                        PROT_READ, MAP_SHARED, fd, 0);
+                // MAP_POPULATE reads the whole file in up front so the
+                // first render doesn't stall on faults
+                int flags = MAP_SHARED;
+                if(prefault)
+                    flags |= MAP_POPULATE;
+                void *mapped = mmap(NULL, this->numValues*sizeof(float),
+                        PROT_READ, flags, fd, 0);
+                if(mapped == MAP_FAILED) {
+                    std::cerr << "Could not memory map file!" << std::endl;
+                }
+                else {
+                    this->data = (float *)mapped;
+                    this->wasMemoryMapped = true;
+                }
             }
             else {
-                this->data = (float *)malloc(this->numValues * sizeof(float));
+                this->data = this->allocateData();
                 size_t bytes = fread(this->data, sizeof(float), this->numValues,
                         dataFile);
             }
             fclose(dataFile);
         }
     }
-    this->wasMemoryMapped = memmap;
+
+    long minorEnd, majorEnd;
+    getPageFaults(minorEnd, majorEnd);
+    this->minorFaults += minorEnd - minorStart;
+    this->majorFaults += majorEnd - majorStart;
+}
+
+bool DataFile::loadShared(std::string variable)
+{
+    // a file that was rewritten gets a segment of its own
+    std::string identity = getFileIdentity(this->filename);
+    if(identity.empty())
+        return false;
+
+    int x = this->fileXDim, y = this->fileYDim, z = this->fileZDim;
+    if(this->filetype == NETCDF) {
+#ifdef PBNJ_NETCDF
+        netCDF::NcFile dataFile(this->filename.c_str(), netCDF::NcFile::read);
+        netCDF::NcVar var = getVariable(dataFile, variable);
+        x = (int) var.getDim(2).getSize();
+        y = (int) var.getDim(1).getSize();
+        z = (int) var.getDim(0).getSize();
+#else
+        return false;
+#endif
+    }
+
+    unsigned int factor = this->downsample;
+    int outX = (x + factor - 1) / factor;
+    int outY = (y + factor - 1) / factor;
+    int outZ = (z + factor - 1) / factor;
+    long int count = (long int)outX * outY * outZ;
+    std::string key = identity + ":" + variable + ":" + std::to_string(x) +
+        "x" + std::to_string(y) + "x" + std::to_string(z) + ":" +
+        std::to_string(factor) + ":" + std::to_string(this->decimation);
+
+    const void *shared = this->sharedStore->acquire(key,
+            count * sizeof(float), [&](void *buffer) {
+        if(this->filetype == BINARY && factor == 1) {
+            FILE *dataFile = fopen(this->filename.c_str(), "r");
+            if(dataFile == NULL)
+                return false;
+            size_t read = fread(buffer, sizeof(float), count, dataFile);
+            fclose(dataFile);
+            return read == (size_t)count;
+        }
+        // downsampling reads through a private copy
+        DataFile loaded(x, y, z);
+        loaded.loadFromFile(this->filename, variable, false, false, factor,
+                this->decimation);
+        if(loaded.data == NULL || loaded.numValues != count)
+            return false;
+        memcpy(buffer, loaded.data, count * sizeof(float));
+        return true;
+    });
+    if(shared == NULL)
+        return false;
+
+    this->fileXDim = x;
+    this->fileYDim = y;
+    this->fileZDim = z;
+    this->xDim = outX;
+    this->yDim = outY;
+    this->zDim = outZ;
+    this->numValues = count;
+    this->data = (float *)shared;
+    this->wasShared = true;
+    return true;
+}
+
+bool DataFile::readDimensions(std::string filename, std::string var_name)
+{
+    this->filename = filename;
+    this->filetype = getFiletype();
+    // raw files have no header, the configured dimensions are all there is
+    if(this->filetype != NETCDF)
+        return this->filetype == BINARY;
+#ifdef PBNJ_NETCDF
+    netCDF::NcFile dataFile(filename.c_str(), netCDF::NcFile::read);
+    netCDF::NcVar variable = getVariable(dataFile, var_name);
+    this->fileXDim = this->xDim = (int) variable.getDim(2).getSize();
+    this->fileYDim = this->yDim = (int) variable.getDim(1).getSize();
+    this->fileZDim = this->zDim = (int) variable.getDim(0).getSize();
+    this->numValues = (long int)this->xDim * this->yDim * this->zDim;
+    return true;
+#else
+    std::cerr << "PBNJ was not built with NetCDF support!" << std::endl;
+    return false;
+#endif
+}
+
+void DataFile::readDecimated(FILE *dataFile, int x, int y, int z)
+{
+    unsigned int factor = this->downsample;
+    long int slice = (long int)x * y;
+
+    if(this->decimation == DECIMATE_STRIDE) {
+        // only the rows holding sampled voxels are read, factor^2 fewer
+        // than the whole file
+        int fd = fileno(dataFile);
+        std::vector<float> row(x);
+        float *out = this->data;
+        for(int k = 0; k < this->zDim; k++) {
+            for(int j = 0; j < this->yDim; j++) {
+                off_t offset = ((long int)k * factor * slice +
+                        (long int)j * factor * x) * sizeof(float);
+                ssize_t bytes = pread(fd, row.data(), x * sizeof(float),
+                        offset);
+                if(bytes != (ssize_t)(x * sizeof(float))) {
+                    std::cerr << "WARNING: Could not read all of the file!";
+                    std::cerr << std::endl;
+                    // the rest of the voxels are left empty
+                    std::fill(out, this->data + this->numValues, 0.0f);
+                    return;
+                }
+                for(int i = 0; i < this->xDim; i++)
+                    *out++ = row[(long int)i * factor];
+            }
+        }
+    }
+    else {
+        // every value is read but only a slab of factor slices is held
+        // at a time
+        std::vector<float> slab(factor * slice);
+        for(int k = 0; k < this->zDim; k++) {
+            int depth = std::min((int)factor, z - k * (int)factor);
+            size_t count = fread(slab.data(), sizeof(float), depth * slice,
+                    dataFile);
+            if(count != (size_t)(depth * slice)) {
+                std::cerr << "WARNING: Could not read all of the file!";
+                std::cerr << std::endl;
+                std::fill(this->data + (long int)k * this->xDim * this->yDim,
+                        this->data + this->numValues, 0.0f);
+                return;
+            }
+            averageSlab(slab.data(), x, y, depth, factor,
+                    this->data + (long int)k * this->xDim * this->yDim);
+        }
+    }
+}
+
+void DataFile::adviseAccess(ACCESSHINT hint)
+{
+    // only file-backed mappings benefit from readahead hints
+    if(this->data == NULL || !this->wasMemoryMapped)
+        return;
+
+    int advice = MADV_NORMAL;
+    if(hint == ACCESS_SEQUENTIAL)
+        advice = MADV_SEQUENTIAL;
+    else if(hint == ACCESS_RANDOM)
+        advice = MADV_RANDOM;
+    else if(hint == ACCESS_WILLNEED)
+        advice = MADV_WILLNEED;
+
+    int result = madvise(this->data, this->numValues*sizeof(float), advice);
+    if(result == -1)
+        std::cerr << "WARNING: madvise failed on mapped data" << std::endl;
+}
+
+float *DataFile::allocateData()
+{
+    size_t bytes = this->numValues * sizeof(float);
+#ifdef MADV_HUGEPAGE
+    // align large buffers to the huge page size and ask for transparent
+    // huge pages, which takes 512x fewer faults to fill the buffer
+    if(bytes >= HUGE_PAGE_SIZE) {
+        void *buffer = NULL;
+        if(posix_memalign(&buffer, HUGE_PAGE_SIZE, bytes) == 0) {
+            madvise(buffer, bytes, MADV_HUGEPAGE);
+            return (float *)buffer;
+        }
+    }
+#endif
+    return (float *)malloc(bytes);
 }
 
 FILETYPE DataFile::getFiletype()
@@ -124,35 +453,168 @@ FILETYPE DataFile::getFiletype()
 }
 
 void DataFile::calculateStatistics()
+{
+    // quantized data keeps the statistics of the floats it came from
+    if(this->quantizedBits != 0)
+        return;
+    this->setStatistics(this->computeStatistics());
+}
+
+DataStatistics DataFile::computeStatistics()
 {
     // calculate min, max, avg, stddev
     // stddev and avg may be useful for automatic diverging color maps
-    this->minVal = data[0];
-    this->maxVal = data[0];
+    DataStatistics stats;
+    // a single front to back pass, let the kernel read ahead aggressively
+    this->adviseAccess(ACCESS_SEQUENTIAL);
+
+    // only reads the data, so a Volume can run this in the background
+    // while rendering with estimated statistics
+    // threads take layers of bricks, so the macrocell ranges come out of
+    // the same pass over the data
+    long int nx = this->xDim, ny = this->yDim, nz = this->zDim;
+    MacrocellGrid *grid = new MacrocellGrid(nx, ny, nz);
+    long int brickSize = grid->brickSize;
+    std::vector<float> minimums(getNumThreads(), data[0]);
+    std::vector<float> maximums(getNumThreads(), data[0]);
+    std::vector<double> totals(getNumThreads(), 0);
+    std::vector<double> squares(getNumThreads(), 0);
+    std::vector<long> minorFaults(getNumThreads(), 0);
+    std::vector<long> majorFaults(getNumThreads(), 0);
+
+    parallelFor(grid->zBricks, [&](unsigned int thread, long int begin,
+                long int end) {
+        long minorStart, majorStart;
+        getPageFaults(minorStart, majorStart);
+        float minimum = minimums[thread], maximum = maximums[thread];
+        double total = 0, totalSquares = 0;
+        for(long int bz = begin; bz < end; bz++) {
+            // bricks share their last layer of voxels with the next one,
+            // the statistics only count each voxel once
+            long int zLo = bz*brickSize;
+            long int zHi = std::min(zLo + brickSize, nz - 1);
+            long int zOwned = bz == grid->zBricks - 1 ? nz : zLo + brickSize;
+            for(long int z = zLo; z <= zHi; z++)
+            for(long int y = 0; y < ny; y++) {
+                const float *row = &this->data[nx*(y + ny*z)];
+                if(z < zOwned) {
+                    for(long int x = 0; x < nx; x++) {
+                        minimum = std::min(minimum, row[x]);
+                        maximum = std::max(maximum, row[x]);
+                        total += row[x];
+                        totalSquares += row[x]*row[x];
+                    }
+                }
+
+                long int by = y / brickSize;
+                for(long int bx = 0; bx < grid->xBricks; bx++) {
+                    long int xLo = bx*brickSize;
+                    long int xHi = std::min(xLo + brickSize, nx - 1);
+                    float low = row[xLo], high = row[xLo];
+                    for(long int x = xLo + 1; x <= xHi; x++) {
+                        low = std::min(low, row[x]);
+                        high = std::max(high, row[x]);
+                    }
+                    if(by < grid->yBricks)
+                        grid->include(grid->getBrick(bx, by, bz), low, high);
+                    if(y % brickSize == 0 && by > 0)
+                        grid->include(grid->getBrick(bx, by - 1, bz), low,
+                                high);
+                }
+            }
+        }
+        minimums[thread] = minimum;
+        maximums[thread] = maximum;
+        totals[thread] = total;
+        squares[thread] = totalSquares;
+        long minorEnd, majorEnd;
+        getPageFaults(minorEnd, majorEnd);
+        minorFaults[thread] += minorEnd - minorStart;
+        majorFaults[thread] += majorEnd - majorStart;
+    });
+
     double total = 0, totalSquares = 0;
-    for(int i = 1; i < this->numValues; i++) {
-        if(data[i] < this->minVal)
-            this->minVal = data[i];
-        if(data[i] > this->maxVal)
-            this->maxVal = data[i];
-        total += data[i];
-        totalSquares += data[i]*data[i];
-    }
-    this->avgVal = total / this->numValues;
-    this->stdDev = std::sqrt(totalSquares/this->numValues -
-                             this->avgVal*this->avgVal);
+    stats.minorFaults = 0;
+    stats.majorFaults = 0;
+    for(int t = 0; t < totals.size(); t++) {
+        total += totals[t];
+        totalSquares += squares[t];
+        stats.minorFaults += minorFaults[t];
+        stats.majorFaults += majorFaults[t];
+    }
+    stats.minVal = *std::min_element(minimums.begin(), minimums.end());
+    stats.maxVal = *std::max_element(maximums.begin(), maximums.end());
+    stats.avgVal = total / this->numValues;
+    stats.stdDev = std::sqrt(std::max(0.0, totalSquares/this->numValues -
+                                      (double)stats.avgVal*stats.avgVal));
+    stats.macrocells = grid;
+    return stats;
+}
+
+void DataFile::setStatistics(DataStatistics stats)
+{
+    this->minVal = stats.minVal;
+    this->maxVal = stats.maxVal;
+    this->avgVal = stats.avgVal;
+    this->stdDev = stats.stdDev;
+    delete this->macrocells;
+    this->macrocells = stats.macrocells;
     this->statsCalculated = true;
+    this->statsApproximate = false;
+    this->minorFaults += stats.minorFaults;
+    this->majorFaults += stats.majorFaults;
+
+    // bins depend on the value range
+    delete this->histogram;
+    this->histogram = NULL;
+}
+
+void DataFile::estimateStatistics(unsigned int samples)
+{
+    // estimate min, max, avg, stddev from a random subsample
+    // this is enough to set up a transfer function for a first frame
+    if(samples == 0 || samples >= this->numValues ||
+            this->quantizedBits != 0) {
+        this->calculateStatistics();
+        return;
+    }
+
+    // random rather than strided so the samples can't line up with the
+    // grid dimensions; the fixed seed keeps estimates repeatable
+    std::minstd_rand generator(this->numValues);
+    std::uniform_int_distribution<long int> index(0, this->numValues - 1);
+
+    float minimum = data[0];
+    float maximum = data[0];
+    double total = 0, totalSquares = 0;
+    for(unsigned int i = 0; i < samples; i++) {
+        float value = data[index(generator)];
+        if(value < minimum)
+            minimum = value;
+        if(value > maximum)
+            maximum = value;
+        total += value;
+        totalSquares += value*value;
+    }
+    this->minVal = minimum;
+    this->maxVal = maximum;
+    this->avgVal = total / samples;
+    this->stdDev = std::sqrt(std::max(0.0, totalSquares/samples -
+                                      (double)this->avgVal*this->avgVal));
+    this->statsApproximate = true;
 }
 
 void DataFile::printStatistics()
 {
     // debugging purposes
-    if(!this->statsCalculated) {
+    if(!this->statsCalculated && !this->statsApproximate) {
         std::cerr << "Statistics not calculated for this data!" << std::endl;
         return;
     }
 
     std::cout << this->filename << std::endl;
+    if(this->statsApproximate)
+        std::cout << "(statistics estimated from a subsample)" << std::endl;
     std::cout << "dimensions: " << this->xDim << ", "
                                 << this->yDim << ", "
                                 << this->zDim << std::endl;
@@ -160,29 +622,347 @@ void DataFile::printStatistics()
     std::cout << "maximum:    " << this->maxVal << std::endl;
     std::cout << "mean:       " << this->avgVal << std::endl;
     std::cout << "std. dev.:  " << this->stdDev << std::endl;
+    std::cout << "faults:     " << this->minorFaults << " minor, "
+                                << this->majorFaults << " major" << std::endl;
 }
 
-// experimental
-void DataFile::bin(unsigned int num_bins)
+Histogram *DataFile::getHistogram(unsigned int numBins)
 {
     if(!this->statsCalculated)
         this->calculateStatistics();
 
-    float bin_width = (this->maxVal - this->minVal) / num_bins;
-    unsigned int *histogram = (unsigned int *) calloc(num_bins, 
-            sizeof(unsigned int));
+    if(this->histogram != NULL && this->histogram->getNumBins() == numBins)
+        return this->histogram;
+
+    delete this->histogram;
+    this->histogram = new Histogram(numBins, this->minVal, this->maxVal);
+    this->computeHistogram(this->histogram);
+    return this->histogram;
+}
+
+void DataFile::computeHistogram(Histogram *histogram, bool clamp)
+{
+    if(this->quantizedBits == 8)
+        histogram->compute((const unsigned char *)this->quantizedData,
+                this->numValues, this->quantizeOffset, this->quantizeScale,
+                clamp);
+    else if(this->quantizedBits == 16)
+        histogram->compute((const unsigned short *)this->quantizedData,
+                this->numValues, this->quantizeOffset, this->quantizeScale,
+                clamp);
+    else
+        histogram->compute(this->data, this->numValues, clamp);
+}
+
+void DataFile::quantize(unsigned int bits)
+{
+    if(bits != 8 && bits != 16) {
+        std::cerr << "WARNING: can only quantize to 8 or 16 bits, not ";
+        std::cerr << bits << std::endl;
+        return;
+    }
+    if(this->quantizedBits != 0 || this->data == NULL)
+        return;
+    if(!this->statsCalculated || this->statsApproximate)
+        this->calculateStatistics();
+
+    // NaNs become the minimum
+    unsigned int levels = (1u << bits) - 1;
+    this->quantizeOffset = this->minVal;
+    this->quantizeScale = 1.0;
+    if(this->maxVal > this->minVal)
+        this->quantizeScale = (this->maxVal - this->minVal) / levels;
+    float offset = this->quantizeOffset;
+    float inverse = 1.0 / this->quantizeScale;
+    float scale = this->quantizeScale;
+    const float *values = this->data;
+    void *quantized = malloc(this->numValues * (bits / 8));
+    std::vector<float> errors(getNumThreads(), 0.0);
+
+    parallelFor(this->numValues, [&](unsigned int thread, long int begin,
+                long int end) {
+        float error = 0.0;
+        for(long int i = begin; i < end; i++) {
+            unsigned int q = 0;
+            if(values[i] == values[i]) {
+                float level = (values[i] - offset) * inverse + 0.5f;
+                q = std::max(0.0f, std::min((float)levels, level));
+                error = std::max(error, std::fabs(offset + scale*q -
+                            values[i]));
+            }
+            if(bits == 8)
+                ((unsigned char *)quantized)[i] = q;
+            else
+                ((unsigned short *)quantized)[i] = q;
+        }
+        errors[thread] = std::max(errors[thread], error);
+    });
+
+    this->quantizeError = *std::max_element(errors.begin(), errors.end());
+    this->quantizedBits = bits;
+    this->quantizedData = quantized;
+    this->freeData();
+}
+
+DataFile *DataFile::dequantize()
+{
+    DataFile *copy = new DataFile(this->xDim, this->yDim, this->zDim);
+    copy->filename = this->filename;
+    copy->filetype = this->filetype;
+    copy->downsample = this->downsample;
+    copy->decimation = this->decimation;
+    copy->fileXDim = this->fileXDim;
+    copy->fileYDim = this->fileYDim;
+    copy->fileZDim = this->fileZDim;
+    copy->numValues = this->numValues;
+    copy->data = copy->allocateData();
 
-    for(int i = 0; i < this->numValues; i++) {
-        float bin = (this->data[i] - this->minVal) / bin_width;
-        unsigned int hist_index = std::min(num_bins - 1, (unsigned int) bin);
-        histogram[hist_index]++;
+    float *values = copy->data;
+    if(this->quantizedBits == 0)
+        std::copy(this->data, this->data + this->numValues, values);
+    else {
+        float offset = this->quantizeOffset;
+        float scale = this->quantizeScale;
+        const unsigned char *bytes = (const unsigned char *)this->quantizedData;
+        const unsigned short *shorts =
+            (const unsigned short *)this->quantizedData;
+        bool wide = this->quantizedBits == 16;
+        parallelFor(this->numValues, [&](unsigned int thread, long int begin,
+                    long int end) {
+            for(long int i = begin; i < end; i++)
+                values[i] = offset + scale * (wide ? shorts[i] : bytes[i]);
+        });
     }
+    copy->calculateStatistics();
+    return copy;
+}
+
+// one multiply-add per input value, simple enough for the compiler to
+// vectorize, with quantized values scaled back as they're read
+template<typename T>
+static void blendValues(const T *a, const T *b, float base, float aScale,
+        float bScale, long int count, float *out)
+{
+    parallelFor(count, [&](unsigned int thread, long int begin,
+                long int end) {
+        // locals, so the loop doesn't reload the captured pointers
+        const T *aValues = a;
+        const T *bValues = b;
+        float *outValues = out;
+        for(long int i = begin; i < end; i++)
+            outValues[i] = base + aScale * aValues[i] + bScale * bValues[i];
+    });
+}
 
-    std::cout << "Calculated histogram:" << std::endl;
-    for(int i = 0; i < num_bins; i++)
-        std::cout << histogram[i] << std::endl;
+bool DataFile::interpolate(DataFile *a, DataFile *b, float weight)
+{
+    if(a->xDim != this->xDim || a->yDim != this->yDim ||
+            a->zDim != this->zDim || b->xDim != this->xDim ||
+            b->yDim != this->yDim || b->zDim != this->zDim) {
+        std::cerr << "WARNING: can't interpolate between volumes of ";
+        std::cerr << "different dimensions" << std::endl;
+        return false;
+    }
+    if(a->quantizedBits != b->quantizedBits || a->compressed ||
+            b->compressed || this->quantizedBits != 0 || this->compressed) {
+        std::cerr << "WARNING: can't interpolate between volumes held ";
+        std::cerr << "differently" << std::endl;
+        return false;
+    }
+    // e.g. a timestep that failed to load
+    bool aMissing = a->quantizedBits == 0 ? a->data == NULL :
+        a->quantizedData == NULL;
+    bool bMissing = b->quantizedBits == 0 ? b->data == NULL :
+        b->quantizedData == NULL;
+    if(aMissing || bMissing) {
+        std::cerr << "WARNING: can't interpolate between volumes without ";
+        std::cerr << "data" << std::endl;
+        return false;
+    }
+    MacrocellGrid *aGrid = a->getMacrocells();
+    MacrocellGrid *bGrid = b->getMacrocells();
+    if(this->data == NULL)
+        this->data = this->allocateData();
+
+    float aWeight = 1.0f - weight;
+    if(a->quantizedBits == 0)
+        blendValues(a->data, b->data, 0.0f, aWeight, weight,
+                this->numValues, this->data);
+    else {
+        float base = aWeight * a->quantizeOffset + weight * b->quantizeOffset;
+        float aScale = aWeight * a->quantizeScale;
+        float bScale = weight * b->quantizeScale;
+        if(a->quantizedBits == 8)
+            blendValues((const unsigned char *)a->quantizedData,
+                    (const unsigned char *)b->quantizedData, base, aScale,
+                    bScale, this->numValues, this->data);
+        else
+            blendValues((const unsigned short *)a->quantizedData,
+                    (const unsigned short *)b->quantizedData, base, aScale,
+                    bScale, this->numValues, this->data);
+    }
+
+    // blending ranges bounds the blended values, the mean is exact
+    this->minVal = aWeight * a->minVal + weight * b->minVal;
+    this->maxVal = aWeight * a->maxVal + weight * b->maxVal;
+    this->avgVal = aWeight * a->avgVal + weight * b->avgVal;
+    this->stdDev = aWeight * a->stdDev + weight * b->stdDev;
+    MacrocellGrid *grid = new MacrocellGrid(*aGrid);
+    for(long int brick = 0; brick < grid->getNumBricks(); brick++) {
+        grid->minimums[brick] = aWeight * aGrid->minimums[brick] +
+            weight * bGrid->minimums[brick];
+        grid->maximums[brick] = aWeight * aGrid->maximums[brick] +
+            weight * bGrid->maximums[brick];
+    }
+    delete this->macrocells;
+    this->macrocells = grid;
+    this->statsCalculated = true;
+    this->statsApproximate = false;
+    delete this->histogram;
+    this->histogram = NULL;
+    return true;
+}
+
+unsigned int DataFile::getValueSize()
+{
+    if(this->quantizedBits != 0)
+        return this->quantizedBits / 8;
+    return sizeof(float);
+}
+
+void DataFile::compress()
+{
+    void *values = this->quantizedBits != 0 ? this->quantizedData :
+        (void *)this->data;
+    if(this->compressed || values == NULL)
+        return;
+
+    unsigned int valueSize = this->getValueSize();
+    size_t bytes = this->numValues * valueSize;
+    long int numBlocks = (bytes + COMPRESSION_BLOCK_SIZE - 1) /
+        COMPRESSION_BLOCK_SIZE;
+    this->compressedBlocks.resize(numBlocks);
+    parallelFor(numBlocks, [&](unsigned int thread, long int begin,
+                long int end) {
+        for(long int b = begin; b < end; b++) {
+            size_t start = b * COMPRESSION_BLOCK_SIZE;
+            compressBytes((const unsigned char *)values + start,
+                    std::min(COMPRESSION_BLOCK_SIZE, bytes - start),
+                    valueSize, this->compressedBlocks[b]);
+        }
+    });
+
+    this->compressed = true;
+    if(this->quantizedBits != 0) {
+        free(this->quantizedData);
+        this->quantizedData = NULL;
+    }
+    else
+        this->freeData();
+}
+
+bool DataFile::decompress()
+{
+    if(!this->compressed)
+        return true;
+
+    unsigned int valueSize = this->getValueSize();
+    size_t bytes = this->numValues * valueSize;
+    void *values;
+    if(this->quantizedBits != 0)
+        values = this->quantizedData = malloc(bytes);
+    else
+        values = this->data = this->allocateData();
+
+    long int numBlocks = this->compressedBlocks.size();
+    std::vector<char> valid(numBlocks, 1);
+    parallelFor(numBlocks, [&](unsigned int thread, long int begin,
+                long int end) {
+        for(long int b = begin; b < end; b++) {
+            size_t start = b * COMPRESSION_BLOCK_SIZE;
+            valid[b] = decompressBytes(this->compressedBlocks[b],
+                    (unsigned char *)values + start,
+                    std::min(COMPRESSION_BLOCK_SIZE, bytes - start),
+                    valueSize);
+        }
+    });
+
+    this->compressedBlocks.clear();
+    this->compressed = false;
+    if(std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+        std::cerr << "WARNING: compressed data for " << this->filename;
+        std::cerr << " is damaged" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DataFile::isCompressed()
+{
+    return this->compressed;
+}
+
+unsigned long int DataFile::getResidentBytes()
+{
+    if(!this->compressed)
+        return this->numValues * this->getValueSize();
+    unsigned long int bytes = 0;
+    for(int b = 0; b < this->compressedBlocks.size(); b++)
+        bytes += this->compressedBlocks[b].size();
+    return bytes;
+}
+
+MacrocellGrid *DataFile::getMacrocells()
+{
+    if(!this->statsCalculated)
+        this->calculateStatistics();
+    return this->macrocells;
+}
+
+float DataFile::getPercentile(float percent)
+{
+    Histogram *histogram = this->getHistogram();
+    if(histogram->total == 0)
+        return this->minVal;
+
+    percent = std::max(0.0f, std::min(100.0f, percent));
+    double target = percent / 100.0 * histogram->total;
+    unsigned int numBins = histogram->getNumBins();
+
+    // outliers can stretch the range so far that most of the data lands
+    // in a single bin, so keep re-binning the bin holding the percentile
+    // until it is sparse enough to interpolate in
+    Histogram *refined = NULL;
+    float value = this->minVal;
+    for(int level = 0; ; level++) {
+        unsigned int bin = 0;
+        double below = 0;
+        for(; bin < numBins - 1; bin++) {
+            if(below + histogram->counts[bin] >= target)
+                break;
+            below += histogram->counts[bin];
+        }
+        unsigned long int inBin = histogram->counts[bin];
+        // position of the percentile inside this bin
+        target = std::min(target - below, (double)inBin);
+
+        if(inBin <= numBins || level == 3) {
+            double fraction = inBin == 0 ? 0.0 : target / inBin;
+            value = histogram->edges[bin] + fraction *
+                (histogram->edges[bin+1] - histogram->edges[bin]);
+            break;
+        }
+
+        Histogram *next = new Histogram(numBins, histogram->edges[bin],
+                histogram->edges[bin+1]);
+        this->computeHistogram(next, false);
+        delete refined;
+        refined = next;
+        histogram = next;
+    }
 
-    free(histogram);
+    delete refined;
+    return value;
 }
 
 }
@@ -0,0 +1,125 @@
+#include "Histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace pbnj {
+
+Histogram::Histogram(unsigned int numBins, float minimum, float maximum) :
+    minVal(minimum), maxVal(maximum), total(0)
+{
+    if(numBins == 0) {
+        std::cerr << "WARNING: Histogram needs at least one bin" << std::endl;
+        numBins = 1;
+    }
+
+    this->counts.resize(numBins, 0);
+    this->edges.reserve(numBins + 1);
+    float binWidth = (this->maxVal - this->minVal) / numBins;
+    for(unsigned int i = 0; i < numBins; i++)
+        this->edges.push_back(this->minVal + i*binWidth);
+    this->edges.push_back(this->maxVal);
+}
+
+void Histogram::compute(const float *data, long int count, bool clamp)
+{
+    this->computeScaled(data, count, 0.0f, 1.0f, clamp);
+}
+
+void Histogram::compute(const unsigned char *data, long int count,
+        float offset, float scale, bool clamp)
+{
+    this->computeScaled(data, count, offset, scale, clamp);
+}
+
+void Histogram::compute(const unsigned short *data, long int count,
+        float offset, float scale, bool clamp)
+{
+    this->computeScaled(data, count, offset, scale, clamp);
+}
+
+template<typename T>
+void Histogram::computeScaled(const T *data, long int count, float offset,
+        float valueScale, bool clamp)
+{
+    unsigned int numBins = this->counts.size();
+    float minimum = this->minVal;
+    float maximum = this->maxVal;
+    // a zero width range puts everything in the first bin
+    float scale = 0.0;
+    if(this->maxVal > this->minVal)
+        scale = numBins / (this->maxVal - this->minVal);
+
+    std::vector<std::vector<unsigned long int> > partials(getNumThreads(),
+            std::vector<unsigned long int>(numBins, 0));
+
+    parallelFor(count, [&](unsigned int thread, long int begin, long int end) {
+        std::vector<unsigned long int> &local = partials[thread];
+        for(long int i = begin; i < end; i++) {
+            float value = offset + valueScale * data[i];
+            // skip NaNs and infinities, which have no bin
+            if(!std::isfinite(value))
+                continue;
+            if(!clamp && (value < minimum || value > maximum))
+                continue;
+            // clamped in floats, far out values don't fit in an int
+            float bin = (value - minimum) * scale;
+            if(bin < 0)
+                bin = 0;
+            unsigned int index = bin >= numBins ? numBins - 1 :
+                (unsigned int) bin;
+            local[index]++;
+        }
+    });
+
+    std::fill(this->counts.begin(), this->counts.end(), 0);
+    this->total = 0;
+    for(int t = 0; t < partials.size(); t++) {
+        for(unsigned int b = 0; b < numBins; b++) {
+            this->counts[b] += partials[t][b];
+            this->total += partials[t][b];
+        }
+    }
+}
+
+unsigned int Histogram::getNumBins()
+{
+    return this->counts.size();
+}
+
+float Histogram::getPercentile(float percent)
+{
+    if(this->total == 0)
+        return this->minVal;
+
+    percent = std::max(0.0f, std::min(100.0f, percent));
+    double target = percent / 100.0 * this->total;
+
+    // walk the cumulative counts and interpolate inside the bin that
+    // crosses the target
+    double cumulative = 0;
+    for(unsigned int i = 0; i < this->counts.size(); i++) {
+        if(this->counts[i] == 0)
+            continue;
+        if(cumulative + this->counts[i] >= target) {
+            double fraction = (target - cumulative) / this->counts[i];
+            return this->edges[i] +
+                fraction * (this->edges[i+1] - this->edges[i]);
+        }
+        cumulative += this->counts[i];
+    }
+    return this->maxVal;
+}
+
+std::vector<float> Histogram::getLogCounts()
+{
+    std::vector<float> logCounts;
+    logCounts.reserve(this->counts.size());
+    for(unsigned int i = 0; i < this->counts.size(); i++)
+        logCounts.push_back(std::log10(1.0 + this->counts[i]));
+    return logCounts;
+}
+
+}
@@ -0,0 +1,93 @@
+#include "MacrocellGrid.h"
+#include "TransferFunction.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace pbnj {
+
+MacrocellGrid::MacrocellGrid(int x, int y, int z, int brickSize) :
+    xDim(x), yDim(y), zDim(z), brickSize(std::max(brickSize, 1))
+{
+    // a dimension of one voxel has no cells but still gets a brick
+    this->xBricks = std::max(x - 2, 0) / this->brickSize + 1;
+    this->yBricks = std::max(y - 2, 0) / this->brickSize + 1;
+    this->zBricks = std::max(z - 2, 0) / this->brickSize + 1;
+
+    // empty ranges until include() is called
+    long int numBricks = this->getNumBricks();
+    this->minimums.resize(numBricks, std::numeric_limits<float>::max());
+    this->maximums.resize(numBricks, -std::numeric_limits<float>::max());
+}
+
+long int MacrocellGrid::getNumBricks()
+{
+    return (long int)this->xBricks * this->yBricks * this->zBricks;
+}
+
+long int MacrocellGrid::getBrick(int bx, int by, int bz)
+{
+    return bx + (long int)this->xBricks * (by + (long int)this->yBricks * bz);
+}
+
+void MacrocellGrid::getBrickVoxels(long int brick, int *lo, int *hi)
+{
+    int b[3] = {(int)(brick % this->xBricks),
+        (int)((brick / this->xBricks) % this->yBricks),
+        (int)(brick / ((long int)this->xBricks * this->yBricks))};
+    int dims[3] = {this->xDim, this->yDim, this->zDim};
+    for(int axis = 0; axis < 3; axis++) {
+        lo[axis] = b[axis] * this->brickSize;
+        hi[axis] = std::min(lo[axis] + this->brickSize, dims[axis] - 1);
+    }
+}
+
+void MacrocellGrid::include(long int brick, float minimum, float maximum)
+{
+    this->minimums[brick] = std::min(this->minimums[brick], minimum);
+    this->maximums[brick] = std::max(this->maximums[brick], maximum);
+}
+
+bool MacrocellGrid::crossesIsovalue(long int brick, float isovalue)
+{
+    // voxels above the isovalue are inside, see TriangleMesh
+    return this->minimums[brick] <= isovalue &&
+        this->maximums[brick] > isovalue;
+}
+
+bool MacrocellGrid::overlapsRange(long int brick, float low, float high)
+{
+    return this->minimums[brick] <= high && this->maximums[brick] >= low;
+}
+
+std::vector<bool> MacrocellGrid::getVisibleBricks(TransferFunction *tf)
+{
+    std::vector<bool> visible(this->getNumBricks());
+    for(long int b = 0; b < visible.size(); b++)
+        visible[b] = this->minimums[b] <= this->maximums[b] &&
+            tf->getMaxOpacity(this->minimums[b], this->maximums[b]) > 0.0;
+    return visible;
+}
+
+std::vector<int> MacrocellGrid::getBounds(const std::vector<bool> &bricks)
+{
+    std::vector<int> bounds;
+    int lo[3], hi[3];
+    for(long int b = 0; b < bricks.size(); b++) {
+        if(!bricks[b])
+            continue;
+        this->getBrickVoxels(b, lo, hi);
+        if(bounds.empty()) {
+            bounds = {lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]};
+            continue;
+        }
+        for(int axis = 0; axis < 3; axis++) {
+            bounds[axis] = std::min(bounds[axis], lo[axis]);
+            bounds[axis + 3] = std::max(bounds[axis + 3], hi[axis]);
+        }
+    }
+    return bounds;
+}
+
+}
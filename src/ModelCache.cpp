@@ -0,0 +1,88 @@
+#include "ModelCache.h"
+#include "Volume.h"
+
+#include <iostream>
+
+#include <ospray/ospray.h>
+
+namespace pbnj {
+
+ModelCache::ModelCache(unsigned int maxUnused) :
+    maxUnused(maxUnused)
+{
+}
+
+ModelCache::~ModelCache()
+{
+    for(auto entry = this->models.begin(); entry != this->models.end();
+            entry++)
+        ospRelease(entry->second.model);
+}
+
+OSPModel ModelCache::acquire(Volume *v)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto found = this->models.find(v->ID);
+    if(found != this->models.end()) {
+        if(found->second.references == 0)
+            this->unused.remove(v->ID);
+        found->second.references++;
+        return found->second.model;
+    }
+
+    Entry entry;
+    entry.model = ospNewModel();
+    ospAddVolume(entry.model, v->asOSPRayObject());
+    ospCommit(entry.model);
+    entry.references = 1;
+    entry.volumeVersion = v->getVersion();
+    this->models[v->ID] = entry;
+    return entry.model;
+}
+
+void ModelCache::release(unsigned long int volumeID)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto found = this->models.find(volumeID);
+    if(found == this->models.end() || found->second.references == 0) {
+        std::cerr << "WARNING: released a model that wasn't acquired";
+        std::cerr << std::endl;
+        return;
+    }
+    if(--found->second.references > 0)
+        return;
+
+    // volume IDs are never reused, so a model whose volume was deleted is
+    // never asked for again and simply ages out of here
+    this->unused.push_back(volumeID);
+    while(this->unused.size() > this->maxUnused) {
+        auto oldest = this->models.find(this->unused.front());
+        ospRelease(oldest->second.model);
+        this->models.erase(oldest);
+        this->unused.pop_front();
+    }
+}
+
+void ModelCache::commit(Volume *v)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    // every renderer holding the model notices the change, but only the
+    // first one needs to commit it
+    auto found = this->models.find(v->ID);
+    if(found == this->models.end() ||
+            found->second.volumeVersion == v->getVersion())
+        return;
+    ospCommit(found->second.model);
+    found->second.volumeVersion = v->getVersion();
+}
+
+unsigned int ModelCache::size()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->models.size();
+}
+
+}
@@ -151,4 +151,7 @@ std::vector<float> reverseExponential = {
 
 std::vector<float> flat = {1.0, 1.0};
 
+// the transfer function's default
+std::vector<float> ramp = {0.0, 1.0};
+
 }
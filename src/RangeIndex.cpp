@@ -0,0 +1,301 @@
+#include "DataFile.h"
+#include "MacrocellGrid.h"
+#include "RangeIndex.h"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+namespace pbnj {
+
+// first bytes of a saved index, bump the digit if the layout changes
+static const char INDEX_MAGIC[8] = {'P', 'B', 'N', 'J', 'R', 'I', 'X', '1'};
+
+RangeIndex::RangeIndex(std::vector<std::string> filenames, int x, int y,
+        int z, std::string variable) :
+    filenames(filenames), variable(variable), xDim(x), yDim(y), zDim(z),
+    stopping(false)
+{
+    Entry empty = {"", 0.0, 0.0, NULL};
+    this->entries.resize(filenames.size(), empty);
+}
+
+RangeIndex::~RangeIndex()
+{
+    this->stopping = true;
+    this->wait();
+    for(int t = 0; t < this->entries.size(); t++)
+        delete this->entries[t].grid;
+}
+
+std::string RangeIndex::getIdentity(unsigned int timestep)
+{
+    // a file that was rewritten since it was indexed has to be redone
+    return getFileIdentity(this->filenames[timestep]);
+}
+
+void RangeIndex::add(unsigned int timestep, MacrocellGrid *grid)
+{
+    if(timestep >= this->entries.size() || grid == NULL)
+        return;
+
+    // keep a copy, the grid belongs to its DataFile
+    MacrocellGrid *copy = new MacrocellGrid(*grid);
+    float minimum = *std::min_element(copy->minimums.begin(),
+            copy->minimums.end());
+    float maximum = *std::max_element(copy->maximums.begin(),
+            copy->maximums.end());
+    std::string identity = this->getIdentity(timestep);
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    Entry &entry = this->entries[timestep];
+    delete entry.grid;
+    entry.grid = copy;
+    entry.identity = identity;
+    entry.minimum = minimum;
+    entry.maximum = maximum;
+}
+
+bool RangeIndex::isIndexed(unsigned int timestep)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return timestep < this->entries.size() &&
+        this->entries[timestep].grid != NULL;
+}
+
+unsigned int RangeIndex::getNumIndexed()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    unsigned int count = 0;
+    for(int t = 0; t < this->entries.size(); t++)
+        if(this->entries[t].grid != NULL)
+            count++;
+    return count;
+}
+
+bool RangeIndex::getValueRange(float &minimum, float &maximum)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if(this->entries.empty())
+        return false;
+    for(int t = 0; t < this->entries.size(); t++) {
+        if(this->entries[t].grid == NULL)
+            return false;
+        if(t == 0 || this->entries[t].minimum < minimum)
+            minimum = this->entries[t].minimum;
+        if(t == 0 || this->entries[t].maximum > maximum)
+            maximum = this->entries[t].maximum;
+    }
+    return true;
+}
+
+void RangeIndex::build(std::string indexFilename)
+{
+    if(this->builder.joinable()) {
+        std::cerr << "WARNING: Range index is already being built";
+        std::cerr << std::endl;
+        return;
+    }
+    this->stopping = false;
+    this->builder = std::thread(&RangeIndex::buildEntries, this,
+            indexFilename);
+}
+
+void RangeIndex::wait()
+{
+    if(this->builder.joinable())
+        this->builder.join();
+}
+
+void RangeIndex::buildEntries(std::string indexFilename)
+{
+    for(unsigned int t = 0; t < this->entries.size() && !this->stopping;
+            t++) {
+        if(this->isIndexed(t))
+            continue;
+
+        // the statistics pass reads the file front to back once, mapping
+        // it saves allocating a buffer for data that isn't kept
+        // a short file would fault past its end, so check it first
+        DataFile dataFile(this->xDim, this->yDim, this->zDim);
+        struct stat info;
+        bool netcdf = this->filenames[t].rfind(".nc") ==
+            this->filenames[t].size() - 3;
+        if(!netcdf && (stat(this->filenames[t].c_str(), &info) != 0 ||
+                    info.st_size < dataFile.numValues*sizeof(float))) {
+            std::cerr << "WARNING: Could not index " << this->filenames[t];
+            std::cerr << std::endl;
+            continue;
+        }
+        dataFile.loadFromFile(this->filenames[t], this->variable, true);
+        if(dataFile.data == NULL)
+            continue;
+        this->add(t, dataFile.getMacrocells());
+    }
+
+    if(!this->stopping && !indexFilename.empty())
+        this->save(indexFilename);
+}
+
+bool RangeIndex::save(std::string indexFilename)
+{
+    FILE *file = fopen(indexFilename.c_str(), "wb");
+    if(file == NULL) {
+        std::cerr << "Could not open " << indexFilename << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    unsigned int numEntries = this->entries.size();
+    fwrite(INDEX_MAGIC, 1, sizeof(INDEX_MAGIC), file);
+    fwrite(&numEntries, sizeof(numEntries), 1, file);
+    for(unsigned int t = 0; t < numEntries; t++) {
+        Entry &entry = this->entries[t];
+        unsigned char indexed = entry.grid != NULL;
+        fwrite(&indexed, 1, 1, file);
+        if(!indexed)
+            continue;
+        unsigned int length = entry.identity.size();
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(entry.identity.data(), 1, length, file);
+        MacrocellGrid *grid = entry.grid;
+        int layout[4] = {grid->xDim, grid->yDim, grid->zDim,
+            grid->brickSize};
+        fwrite(layout, sizeof(int), 4, file);
+        fwrite(grid->minimums.data(), sizeof(float), grid->getNumBricks(),
+                file);
+        fwrite(grid->maximums.data(), sizeof(float), grid->getNumBricks(),
+                file);
+    }
+
+    bool written = !ferror(file);
+    fclose(file);
+    if(!written)
+        std::cerr << "Could not write " << indexFilename << std::endl;
+    return written;
+}
+
+bool RangeIndex::load(std::string indexFilename)
+{
+    FILE *file = fopen(indexFilename.c_str(), "rb");
+    if(file == NULL)
+        return false;
+
+    char magic[sizeof(INDEX_MAGIC)];
+    unsigned int numEntries = 0;
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        std::equal(magic, magic + sizeof(magic), INDEX_MAGIC) &&
+        fread(&numEntries, sizeof(numEntries), 1, file) == 1 &&
+        numEntries == this->entries.size();
+
+    unsigned int loaded = 0;
+    for(unsigned int t = 0; valid && t < numEntries; t++) {
+        unsigned char indexed = 0;
+        if(fread(&indexed, 1, 1, file) != 1) {
+            valid = false;
+            break;
+        }
+        if(!indexed)
+            continue;
+
+        unsigned int length = 0;
+        int layout[4];
+        valid = fread(&length, sizeof(length), 1, file) == 1 &&
+            length < 65536;
+        std::string identity(valid ? length : 0, '\0');
+        valid = valid && fread(&identity[0], 1, length, file) == length &&
+            fread(layout, sizeof(int), 4, file) == 4 &&
+            layout[0] > 0 && layout[1] > 0 && layout[2] > 0 && layout[3] > 0;
+        if(!valid)
+            break;
+        MacrocellGrid *grid = new MacrocellGrid(layout[0], layout[1],
+                layout[2], layout[3]);
+        long int numBricks = grid->getNumBricks();
+        valid = fread(grid->minimums.data(), sizeof(float), numBricks,
+                file) == numBricks && fread(grid->maximums.data(),
+                sizeof(float), numBricks, file) == numBricks;
+
+        // skip entries whose files changed after they were indexed
+        if(valid && identity == this->getIdentity(t)) {
+            this->add(t, grid);
+            loaded++;
+        }
+        delete grid;
+    }
+    fclose(file);
+
+    if(!valid)
+        std::cerr << "WARNING: " << indexFilename << " is not a usable "
+                  << "range index for this series" << std::endl;
+    return valid && loaded > 0;
+}
+
+std::vector<unsigned int> RangeIndex::findTimesteps(float low, float high)
+{
+    return this->findTimesteps(low, high, false);
+}
+
+std::vector<unsigned int> RangeIndex::findTimesteps(float isovalue)
+{
+    return this->findTimesteps(isovalue, isovalue, true);
+}
+
+std::vector<long int> RangeIndex::findBricks(unsigned int timestep,
+        float low, float high)
+{
+    return this->findBricks(timestep, low, high, false);
+}
+
+std::vector<long int> RangeIndex::findBricks(unsigned int timestep,
+        float isovalue)
+{
+    return this->findBricks(timestep, isovalue, isovalue, true);
+}
+
+std::vector<unsigned int> RangeIndex::findTimesteps(float low, float high,
+        bool isosurface)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<unsigned int> timesteps;
+    for(unsigned int t = 0; t < this->entries.size(); t++) {
+        Entry &entry = this->entries[t];
+        bool found = entry.grid == NULL;
+        if(!found && isosurface)
+            found = entry.minimum <= low && entry.maximum > low;
+        else if(!found)
+            found = entry.minimum <= high && entry.maximum >= low;
+        if(found)
+            timesteps.push_back(t);
+    }
+    return timesteps;
+}
+
+std::vector<long int> RangeIndex::findBricks(unsigned int timestep,
+        float low, float high, bool isosurface)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<long int> bricks;
+    if(timestep >= this->entries.size())
+        return bricks;
+
+    // without an entry there is no brick layout to go by either, so the
+    // caller gets nothing back and has to check isIndexed()
+    MacrocellGrid *grid = this->entries[timestep].grid;
+    if(grid == NULL)
+        return bricks;
+    for(long int b = 0; b < grid->getNumBricks(); b++) {
+        bool found = isosurface ? grid->crossesIsovalue(b, low) :
+            grid->overlapsRange(b, low, high);
+        if(found)
+            bricks.push_back(b);
+    }
+    return bricks;
+}
+
+}
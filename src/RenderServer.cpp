@@ -0,0 +1,583 @@
+#include "RenderServer.h"
+#include "ConfigReader.h"
+#include "Configuration.h"
+#include "Camera.h"
+#include "RenderSession.h"
+#include "Renderer.h"
+#include "RendererPool.h"
+#include "Scene.h"
+#include "TimeSeries.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "rapidjson/document.h"
+
+namespace pbnj {
+
+RenderServer::RenderServer(std::string configFilename,
+        unsigned int numRenderers) :
+    configFilename(configFilename), scene(NULL), pool(NULL),
+    numRenderers(numRenderers), listenSocket(-1), port(0), running(false),
+    frames(0)
+{
+    // the scene needs OSPRay, so it's built once serving starts
+    ConfigReader reader;
+    reader.parseConfigFile(configFilename, this->config);
+}
+
+RenderServer::~RenderServer()
+{
+    if(this->listenSocket != -1)
+        close(this->listenSocket);
+    if(!this->socketPath.empty())
+        unlink(this->socketPath.c_str());
+    // pool renderers hold models of the scene's volumes
+    delete this->pool;
+    delete this->scene;
+}
+
+bool RenderServer::listenTCP(unsigned short port, std::string address)
+{
+    this->listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if(this->listenSocket == -1) {
+        std::cerr << "ERROR: could not create socket: " << strerror(errno);
+        std::cerr << std::endl;
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(this->listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+            sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "ERROR: invalid address " << address << std::endl;
+        return false;
+    }
+    if(bind(this->listenSocket, (struct sockaddr *)&addr,
+                sizeof(addr)) == -1 ||
+            listen(this->listenSocket, 4) == -1) {
+        std::cerr << "ERROR: could not listen on " << address << ":";
+        std::cerr << port << ": " << strerror(errno) << std::endl;
+        close(this->listenSocket);
+        this->listenSocket = -1;
+        return false;
+    }
+
+    // find out which port we got if any was allowed
+    socklen_t length = sizeof(addr);
+    getsockname(this->listenSocket, (struct sockaddr *)&addr, &length);
+    this->port = ntohs(addr.sin_port);
+    return true;
+}
+
+bool RenderServer::listenUnix(std::string path)
+{
+    struct sockaddr_un addr;
+    if(path.length() >= sizeof(addr.sun_path)) {
+        std::cerr << "ERROR: socket path " << path << " is too long";
+        std::cerr << std::endl;
+        return false;
+    }
+
+    this->listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(this->listenSocket == -1) {
+        std::cerr << "ERROR: could not create socket: " << strerror(errno);
+        std::cerr << std::endl;
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    // a stale socket from an earlier run would make bind fail
+    unlink(path.c_str());
+    if(bind(this->listenSocket, (struct sockaddr *)&addr,
+                sizeof(addr)) == -1 ||
+            listen(this->listenSocket, 4) == -1) {
+        std::cerr << "ERROR: could not listen on " << path << ": ";
+        std::cerr << strerror(errno) << std::endl;
+        close(this->listenSocket);
+        this->listenSocket = -1;
+        return false;
+    }
+    this->socketPath = path;
+    return true;
+}
+
+unsigned short RenderServer::getPort()
+{
+    return this->port;
+}
+
+Scene *RenderServer::getScene()
+{
+    return this->scene;
+}
+
+RendererPool *RenderServer::getRendererPool()
+{
+    return this->pool;
+}
+
+void RenderServer::serve()
+{
+    if(this->listenSocket == -1) {
+        std::cerr << "ERROR: call listenTCP() or listenUnix() before serve()";
+        std::cerr << std::endl;
+        return;
+    }
+
+    if(this->scene == NULL) {
+        Configuration startConfig(this->config);
+        this->scene = new Scene(&startConfig);
+        this->pool = new RendererPool(this->numRenderers);
+    }
+
+    this->running = true;
+    while(this->running) {
+        int client = accept(this->listenSocket, NULL, NULL);
+        if(client == -1) {
+            if(errno == EINTR)
+                continue;
+            // shutting down closes the listening socket under accept()
+            if(this->running) {
+                std::cerr << "ERROR: accept failed: " << strerror(errno);
+                std::cerr << std::endl;
+            }
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->clientLock);
+            this->clients.insert(client);
+        }
+        std::thread(&RenderServer::handleConnection, this, client).detach();
+    }
+
+    // hang up on everyone else and wait for them to finish
+    this->running = false;
+    std::unique_lock<std::mutex> guard(this->clientLock);
+    for(auto client = this->clients.begin(); client != this->clients.end();
+            client++)
+        shutdown(*client, SHUT_RDWR);
+    this->connectionsDone.wait(guard, [this]() {
+        return this->clients.empty();
+    });
+}
+
+void RenderServer::handleConnection(int client)
+{
+    // a reader thread fills the session's mailbox while this thread
+    // renders, so requests that arrive during a frame are coalesced
+    // instead of queueing up behind it
+    RenderSession session(client);
+    {
+        std::lock_guard<std::mutex> guard(this->pool->getObjectLock());
+        session.config.CopyFrom(this->config, session.config.GetAllocator());
+    }
+    std::thread reader([client, &session]() {
+        // requests are newline delimited and may arrive in any number of
+        // pieces
+        std::string pending;
+        char buffer[4096];
+        while(true) {
+            ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+            if(received == -1 && errno == EINTR)
+                continue;
+            if(received <= 0)
+                break;
+            pending.append(buffer, received);
+
+            std::string::size_type newline;
+            while((newline = pending.find('\n')) != std::string::npos) {
+                std::string request = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if(request.find_first_not_of(" \t\r") != std::string::npos)
+                    session.post(request);
+            }
+        }
+        session.close();
+    });
+
+    std::vector<SessionRequest> requests;
+    while(this->running && session.take(requests)) {
+        if(!this->handleRequests(session, requests))
+            break;
+    }
+
+    // wake the reader if it is still waiting on the client
+    shutdown(client, SHUT_RDWR);
+    reader.join();
+
+    this->pool->unassign(session.ID);
+    {
+        std::lock_guard<std::mutex> guard(this->pool->getObjectLock());
+        delete session.camera;
+    }
+    delete session.lastConfig;
+    session.printMetrics();
+
+    // a shutdown also has to stop the accept() loop
+    if(!this->running)
+        shutdown(this->listenSocket, SHUT_RDWR);
+
+    // serve() may return as soon as this is done
+    std::lock_guard<std::mutex> guard(this->clientLock);
+    this->clients.erase(client);
+    close(client);
+    this->connectionsDone.notify_all();
+}
+
+// settings that each client has for itself rather than sharing
+static bool isSessionSetting(std::string name)
+{
+    return name == "cameraPosition" || name == "cameraUpVector" ||
+        name == "imageSize" || name == "samplesPerPixel" ||
+        name == "backgroundColor" || name == "isosurfaceValues" ||
+        name == "isosurfaceMeshes";
+}
+
+static std::string checkRequest(const rapidjson::Value &json)
+{
+    for(rapidjson::Value::ConstMemberIterator member = json.MemberBegin();
+            member != json.MemberEnd(); member++) {
+        std::string name = member->name.GetString();
+        std::string error = Configuration::checkSetting(name, member->value);
+        if(!error.empty())
+            return error;
+    }
+    return "";
+}
+
+bool RenderServer::handleRequests(RenderSession &session,
+        std::vector<SessionRequest> &requests)
+{
+    int client = session.socket;
+
+    // requests with a setting the configuration can't take are refused
+    // whole, before any of it is merged
+    std::vector<std::unique_ptr<rapidjson::Document> > parsed;
+    std::vector<std::string> errors(requests.size());
+    int newest = -1;
+    for(int r = 0; r < requests.size(); r++) {
+        parsed.push_back(std::unique_ptr<rapidjson::Document>(
+                    new rapidjson::Document()));
+        parsed[r]->Parse(requests[r].text.c_str());
+        if(parsed[r]->HasParseError() || !parsed[r]->IsObject())
+            errors[r] = "request is not a JSON object";
+        else
+            errors[r] = checkRequest(*parsed[r]);
+        if(errors[r].empty())
+            newest = r;
+    }
+
+    // fold every request into the configuration in order, only the
+    // newest one gets a frame and the rest are answered as dropped
+    bool render = true;
+    bool raw = false;
+    bool sharedChanged = false;
+    for(int r = 0; r <= newest; r++) {
+        rapidjson::Document &json = *parsed[r];
+        if(!errors[r].empty()) {
+            if(!this->replyError(client, errors[r]))
+                return false;
+            continue;
+        }
+
+        if(json.HasMember("shutdown") && json["shutdown"].IsBool() &&
+                json["shutdown"].GetBool()) {
+            this->running = false;
+            std::vector<unsigned char> none;
+            this->reply(client, "{\"status\": \"ok\", \"bytes\": 0}", none);
+            return false;
+        }
+
+        // everything else replaces the matching config setting, either
+        // the client's own or the one shared with everybody
+        render = true;
+        raw = false;
+        for(rapidjson::Value::ConstMemberIterator member = json.MemberBegin();
+                member != json.MemberEnd(); member++) {
+            std::string name = member->name.GetString();
+            if(name == "render" && member->value.IsBool())
+                render = member->value.GetBool();
+            else if(name == "format" && member->value.IsString())
+                raw = std::string(member->value.GetString()) == "raw";
+            else if(name == "timestep" && member->value.IsUint()) {
+                session.timestep = member->value.GetUint();
+                session.time = -1.0;
+            }
+            else if(name == "time" && member->value.IsNumber() &&
+                    member->value.GetDouble() >= 0.0) {
+                session.time = member->value.GetDouble();
+                session.timestep = (unsigned int)session.time;
+            }
+            else if(name == "fullResolution" && member->value.IsBool())
+                session.fullResolution = member->value.GetBool();
+            else {
+                rapidjson::Document *target = &session.config;
+                std::unique_lock<std::mutex> guard(
+                        this->pool->getObjectLock(), std::defer_lock);
+                if(!isSessionSetting(name)) {
+                    target = &this->config;
+                    guard.lock();
+                    sharedChanged = true;
+                }
+                rapidjson::Document::AllocatorType &allocator =
+                    target->GetAllocator();
+                if(target->HasMember(member->name))
+                    (*target)[member->name].CopyFrom(member->value,
+                            allocator);
+                else
+                    target->AddMember(
+                            rapidjson::Value(member->name, allocator),
+                            rapidjson::Value(member->value, allocator),
+                            allocator);
+            }
+        }
+
+        if(r < newest) {
+            session.dropped++;
+            if(!this->replyDropped(client))
+                return false;
+        }
+    }
+
+    if(newest >= 0 && !this->renderNewest(session, requests[newest], render,
+                raw, sharedChanged))
+        return false;
+
+    // anything refused after the newest request
+    for(int r = newest + 1; r < requests.size(); r++)
+        if(!this->replyError(client, errors[r]))
+            return false;
+    return true;
+}
+
+bool RenderServer::renderNewest(RenderSession &session,
+        SessionRequest &request, bool render, bool raw, bool sharedChanged)
+{
+    int client = session.socket;
+    auto start = std::chrono::steady_clock::now();
+    double latency = std::chrono::duration<double>(
+            start - request.arrival).count();
+
+    // the client's settings, read before taking any locks
+    Configuration *local = new Configuration(session.config);
+    unsigned int changes = CHANGE_CAMERA | CHANGE_RENDERER;
+    if(session.lastConfig != NULL)
+        changes = session.lastConfig->diff(local) &
+            (CHANGE_CAMERA | CHANGE_RENDERER);
+    delete session.lastConfig;
+    session.lastConfig = local;
+
+    Renderer *renderer = this->pool->acquire(session.ID);
+    TimeSeries *series = NULL;
+    bool committed = false;
+    {
+        std::unique_lock<std::mutex> guard(this->pool->getObjectLock());
+
+        // shared changes and newly loaded timesteps touch objects other
+        // clients' frames are reading
+        series = this->scene->getTimeSeries();
+        // only one full resolution timestep and one blend are kept, so
+        // asking for another rewrites the one other frames may be
+        // rendering
+        bool loading = false;
+        if(series != NULL && session.timestep < series->getLength()) {
+            if(session.time >= 0.0)
+                loading = !series->isInterpolated(session.time);
+            else if(session.fullResolution)
+                loading = !series->isFullResolutionLoaded(session.timestep);
+            else
+                loading = !series->isLoaded(session.timestep);
+        }
+        if(sharedChanged || loading)
+            this->pool->waitForFrames(guard);
+        if(sharedChanged) {
+            Configuration shared(this->config);
+            changes |= this->scene->apply(&shared);
+            series = this->scene->getTimeSeries();
+        }
+
+        Volume *volume = this->scene->getVolume();
+        if(series != NULL) {
+            if(session.timestep >= series->getLength()) {
+                guard.unlock();
+                this->pool->release(session.ID);
+                return this->replyError(client, "timestep is out of range");
+            }
+            if(session.time >= 0.0)
+                volume = series->getInterpolatedVolume(session.time);
+            else if(session.fullResolution)
+                volume = series->getFullResolutionVolume(session.timestep);
+            else
+                volume = series->getVolume(session.timestep);
+            // keep it resident until the frame is done
+            series->pin(session.timestep);
+        }
+        if(volume == NULL) {
+            guard.unlock();
+            this->pool->release(session.ID);
+            return this->replyError(client, "no data to render");
+        }
+
+        if(session.camera == NULL)
+            session.camera = new Camera(local->imageWidth,
+                    local->imageHeight);
+        else if(session.camera->imageWidth != local->imageWidth ||
+                session.camera->imageHeight != local->imageHeight)
+            session.camera->setImageSize(local->imageWidth,
+                    local->imageHeight);
+        session.camera->setPosition(local->cameraX, local->cameraY,
+                local->cameraZ);
+        session.camera->setUpVector(local->cameraUpX, local->cameraUpY,
+                local->cameraUpZ);
+
+        // the renderer may have drawn another client's view last
+        renderer->setCamera(session.camera);
+        renderer->setBackgroundColor(local->bgColor);
+        renderer->setSamples(local->samples);
+        renderer->setProgressive(true);
+        renderer->setIsosurfaceMeshes(local->isosurfaceMeshes);
+        if(local->isosurfaceValues.empty())
+            renderer->setVolume(volume);
+        else
+            renderer->setIsosurface(volume, local->isosurfaceValues);
+
+        if(render)
+            committed = this->pool->commit(renderer);
+        // without a frame in flight a shared change may delete the series
+        // as soon as this lock is released
+        if(series != NULL && !committed) {
+            renderer->detachVolume();
+            series->unpin(session.timestep);
+        }
+    }
+
+    // a newer request makes this frame stale, stop between passes and
+    // let the next take() sort out which state is the newest
+    std::vector<unsigned char> image;
+    bool finished = true;
+    if(committed) {
+        finished = this->pool->renderFrame(renderer, [&session]() {
+            return session.mayCancel() && session.hasPending();
+        });
+        if(finished) {
+            if(raw) {
+                unsigned char *buffer;
+                renderer->renderToBuffer(&buffer, false);
+                image.assign(buffer, buffer +
+                        4 * renderer->cameraWidth * renderer->cameraHeight);
+                free(buffer);
+            }
+            else
+                renderer->renderToPNGObject(image, false);
+        }
+    }
+    int width = renderer->cameraWidth;
+    int height = renderer->cameraHeight;
+    // the volume may be evicted once it's unpinned below, while another
+    // session already has this renderer
+    if(committed && series != NULL)
+        renderer->detachVolume();
+    this->pool->release(session.ID);
+
+    if(committed) {
+        if(series != NULL) {
+            std::lock_guard<std::mutex> guard(this->pool->getObjectLock());
+            series->unpin(session.timestep);
+        }
+        this->pool->finishFrame();
+    }
+
+    if(!finished) {
+        session.cancelled++;
+        session.cancelledLast = true;
+        session.requeue(request);
+        return true;
+    }
+    if(render && !committed)
+        return this->replyError(client, "nothing to render");
+
+    unsigned long int frame = 0;
+    if(render) {
+        session.cancelledLast = false;
+        frame = ++this->frames;
+        session.rendered++;
+        session.recordLatency(latency);
+    }
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    std::stringstream header;
+    header << "{\"status\": \"ok\"";
+    if(render) {
+        header << ", \"frame\": " << frame;
+        header << ", \"width\": " << width;
+        header << ", \"height\": " << height;
+        header << ", \"format\": \"" << (raw ? "raw" : "png") << "\"";
+    }
+    header << ", \"bytes\": " << image.size();
+    header << ", \"changes\": " << changes;
+    header << ", \"renderTime\": " << seconds;
+    header << ", \"queueTime\": " << latency;
+    header << ", \"dropped\": " << session.dropped << "}";
+    return this->reply(client, header.str(), image);
+}
+
+bool RenderServer::reply(int client, std::string header,
+        const std::vector<unsigned char> &data)
+{
+    header += "\n";
+    const char *parts[2] = {header.data(), (const char *)data.data()};
+    size_t lengths[2] = {header.size(), data.size()};
+    for(int p = 0; p < 2; p++) {
+        size_t sent = 0;
+        while(sent < lengths[p]) {
+            // a client that went away shouldn't take the server with it
+            ssize_t result = send(client, parts[p] + sent, lengths[p] - sent,
+                    MSG_NOSIGNAL);
+            if(result == -1 && errno == EINTR)
+                continue;
+            if(result <= 0)
+                return false;
+            sent += result;
+        }
+    }
+    return true;
+}
+
+bool RenderServer::replyDropped(int client)
+{
+    // superseded by a newer request from the same client
+    std::vector<unsigned char> none;
+    return this->reply(client, "{\"status\": \"dropped\", \"bytes\": 0}",
+            none);
+}
+
+bool RenderServer::replyError(int client, std::string message)
+{
+    std::vector<unsigned char> none;
+    return this->reply(client, "{\"status\": \"error\", \"message\": \"" +
+            message + "\", \"bytes\": 0}", none);
+}
+
+}
@@ -0,0 +1,91 @@
+#include "RenderSession.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace pbnj {
+
+RenderSession::RenderSession(int socket) :
+    socket(socket), lastConfig(NULL), camera(NULL), timestep(0),
+    fullResolution(false), time(-1.0), received(0), rendered(0), dropped(0),
+    cancelled(0), cancelledLast(false), totalLatency(0.0), maxLatency(0.0),
+    closed(false)
+{
+    this->ID = createID();
+}
+
+void RenderSession::post(std::string request)
+{
+    SessionRequest r;
+    r.text = request;
+    r.arrival = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->pending.push_back(r);
+        this->received++;
+    }
+    this->arrived.notify_one();
+}
+
+void RenderSession::requeue(SessionRequest &request)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->pending.push_front(request);
+    }
+    this->arrived.notify_one();
+}
+
+void RenderSession::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->closed = true;
+    }
+    this->arrived.notify_one();
+}
+
+bool RenderSession::take(std::vector<SessionRequest> &requests)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->arrived.wait(guard, [this]() {
+        return !this->pending.empty() || this->closed;
+    });
+    if(this->pending.empty())
+        return false;
+
+    requests.assign(this->pending.begin(), this->pending.end());
+    this->pending.clear();
+    return true;
+}
+
+bool RenderSession::hasPending()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return !this->pending.empty();
+}
+
+bool RenderSession::mayCancel()
+{
+    return !this->cancelledLast;
+}
+
+void RenderSession::recordLatency(double seconds)
+{
+    this->totalLatency += seconds;
+    this->maxLatency = std::max(this->maxLatency, seconds);
+}
+
+void RenderSession::printMetrics()
+{
+    double average = this->rendered == 0 ? 0.0 :
+        this->totalLatency / this->rendered;
+    std::cout << "Session " << this->ID << ": " << this->received;
+    std::cout << " requests, " << this->rendered << " frames, ";
+    std::cout << this->dropped << " dropped (" << this->cancelled;
+    std::cout << " cancelled mid-frame), queue latency avg ";
+    std::cout << average * 1000.0 << " ms, max ";
+    std::cout << this->maxLatency * 1000.0 << " ms" << std::endl;
+}
+
+}
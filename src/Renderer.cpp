@@ -1,9 +1,15 @@
 #include "Camera.h"
+#include "CameraPath.h"
+#include "ModelCache.h"
 #include "Renderer.h"
+#include "TriangleMesh.h"
 #include "Volume.h"
 
 #include <algorithm>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <string>
 #include <cstring>
@@ -19,26 +25,36 @@
 namespace pbnj {
 
 Renderer::Renderer() :
-    backgroundColor(), samples(1)
+    backgroundColor(), volume(NULL), camera(NULL), cameraVersion(0),
+    dirty(true), lastVolumeID(0), lastVolumeVersion(0), lastCameraID(0),
+    maxIsosurfaces(8), meshIsosurfaces(false), samples(1), progressive(false),
+    modelCache(NULL), modelCached(false)
 {
     this->oRenderer = ospNewRenderer("scivis");
 
     this->setBackgroundColor(0, 0, 0);
     this->oCamera = NULL;
     this->oModel = NULL;
-    this->oSurface = NULL;
     this->oMaterial = NULL;
-    this->lastVolumeID = "unset";
-    this->lastCameraID = "unset";
+    this->oLights = NULL;
+    this->oFrameBuffer = NULL;
+    this->frameBufferSize.x = 0;
+    this->frameBufferSize.y = 0;
 }
 
 Renderer::~Renderer()
 {
+    // the camera belongs to its Camera object
     ospRelease(this->oRenderer);
-    ospRelease(this->oCamera);
-    ospRelease(this->oModel);
-    ospRelease(this->oSurface);
+    ospRelease(this->oFrameBuffer);
+    this->releaseModel();
+    for(auto surface = this->isosurfaces.begin();
+            surface != this->isosurfaces.end(); surface++)
+        this->releaseIsosurface(*surface);
     ospRelease(this->oMaterial);
+    ospRelease(this->oLights);
+    for(int l = 0; l < this->lights.size(); l++)
+        ospRelease(this->lights[l]);
 }
 
 void Renderer::setBackgroundColor(unsigned char r, unsigned char g, unsigned char b)
@@ -46,9 +62,7 @@ void Renderer::setBackgroundColor(unsigned char r, unsigned char g, unsigned cha
     this->backgroundColor[0] = r;
     this->backgroundColor[1] = g;
     this->backgroundColor[2] = b;
-    float asVec[] = {r/(float)255.0, g/(float)255.0, b/(float)255.0};
-    ospSet3fv(this->oRenderer, "bgColor", asVec);
-    ospCommit(this->oRenderer);
+    this->dirty = true;
 }
 
 void Renderer::setBackgroundColor(std::vector<unsigned char> bgColor)
@@ -61,92 +75,256 @@ void Renderer::setBackgroundColor(std::vector<unsigned char> bgColor)
         this->setBackgroundColor(bgColor[0], bgColor[1], bgColor[2]);
 }
 
+void Renderer::setModelCache(ModelCache *cache)
+{
+    this->releaseModel();
+    this->modelCache = cache;
+    // rebuild the model from the cache next time
+    this->lastVolumeID = 0;
+    this->lastRenderType = "";
+}
+
+void Renderer::setIsosurfaceCacheSize(unsigned int numSurfaces)
+{
+    // the surface being rendered always stays
+    this->maxIsosurfaces = std::max(numSurfaces, (unsigned int)1);
+    while(this->isosurfaces.size() > this->maxIsosurfaces) {
+        this->releaseIsosurface(this->isosurfaces.back());
+        this->isosurfaces.pop_back();
+    }
+}
+
+void Renderer::setIsosurfaceMeshes(bool meshes)
+{
+    this->meshIsosurfaces = meshes;
+}
+
+void Renderer::releaseIsosurface(Isosurface &surface)
+{
+    ospRelease(surface.oModel);
+    if(surface.oGeometry != NULL) {
+        ospRelease(surface.oGeometry);
+        ospRelease(surface.oIsoValues);
+    }
+    for(int m = 0; m < surface.oMeshes.size(); m++)
+        ospRelease(surface.oMeshes[m]);
+}
+
+OSPGeometry Renderer::createMeshGeometry(Volume *v, float isovalue)
+{
+    TriangleMesh *mesh = v->getIsosurfaceMesh(isovalue);
+    if(mesh->getNumTriangles() == 0)
+        return NULL;
+
+    // meshes are in voxel coordinates, put them on the volume's grid
+    std::vector<float> origin = v->getGridOrigin();
+    float spacing = v->getGridSpacing();
+    std::vector<float> vertices(mesh->vertices.size());
+    for(long int i = 0; i < vertices.size(); i++)
+        vertices[i] = origin[i % 3] + mesh->vertices[i]*spacing;
+
+    // the data is copied, so the volume is free to drop its mesh
+    OSPGeometry geometry = ospNewGeometry("triangles");
+    OSPData vertexData = ospNewData(mesh->getNumVertices(), OSP_FLOAT3,
+            vertices.data());
+    OSPData normalData = ospNewData(mesh->getNumVertices(), OSP_FLOAT3,
+            mesh->normals.data());
+    OSPData indexData = ospNewData(mesh->getNumTriangles(), OSP_INT3,
+            mesh->triangles.data());
+    ospSetData(geometry, "vertex", vertexData);
+    ospSetData(geometry, "vertex.normal", normalData);
+    ospSetData(geometry, "index", indexData);
+    ospSetMaterial(geometry, this->oMaterial);
+    ospCommit(geometry);
+    ospRelease(vertexData);
+    ospRelease(normalData);
+    ospRelease(indexData);
+    return geometry;
+}
+
+void Renderer::releaseModel()
+{
+    if(this->oModel == NULL)
+        return;
+    // isosurface models stay in this->isosurfaces
+    if(this->lastRenderType == "isosurface")
+        this->oModel = NULL;
+    else if(this->modelCached)
+        this->modelCache->release(this->lastVolumeID);
+    else
+        ospRelease(this->oModel);
+    this->oModel = NULL;
+    this->modelCached = false;
+}
+
 void Renderer::setVolume(Volume *v)
 {
+    this->volume = v;
     if(this->lastVolumeID == v->ID && this->lastRenderType == "volume") {
         // this is the same volume as the current model and we previously
-        // did a volume render
+        // did a volume render, render() handles any in-place changes
         return;
     }
-    if(this->oModel != NULL) {
-        ospRelease(this->oModel);
-        this->oModel = NULL;
-    }
+    this->releaseModel();
 
     this->lastVolumeID = v->ID;
+    this->lastVolumeVersion = v->getVersion();
     this->lastRenderType = "volume";
-    this->oModel = ospNewModel();
-    ospAddVolume(this->oModel, v->asOSPRayObject());
-    ospCommit(this->oModel);
+    if(this->modelCache != NULL) {
+        // other renderers may already have built this one
+        this->oModel = this->modelCache->acquire(v);
+        this->modelCached = true;
+    }
+    else {
+        this->oModel = ospNewModel();
+        ospAddVolume(this->oModel, v->asOSPRayObject());
+        ospCommit(this->oModel);
+    }
+    this->dirty = true;
+}
+
+void Renderer::detachVolume()
+{
+    // the model keeps its own reference to the OSPRay volume
+    this->volume = NULL;
 }
 
 void Renderer::setIsosurface(Volume *v, std::vector<float> &isoValues)
 {
+    this->volume = v;
+    // the volume's crop would clip surfaces found by intersecting it
+    if(!this->meshIsosurfaces)
+        v->includeIsovalues(isoValues);
     if(this->lastVolumeID == v->ID && this->lastRenderType == "isosurface") {
         // this is the same volume as the current model and we previously
         // did an isosurface render
 
-        // but check if the isoValues are different
-        if(this->lastIsoValues == isoValues) {
+        // but check if the isoValues or the kind of surface are different
+        // meshes also go stale when the values do, e.g. interpolating
+        Isosurface &front = this->isosurfaces.front();
+        if(this->lastIsoValues == isoValues &&
+                front.meshes == this->meshIsosurfaces && (!front.meshes ||
+                    front.volumeVersion == v->getVersion())) {
             return;
         }
     }
-    if(this->oModel != NULL) {
-        ospRelease(this->oModel);
-        this->oModel = NULL;
+    this->releaseModel();
+    this->setupLighting();
+
+    // switching back to a recent surface just moves it to the front
+    auto surface = this->isosurfaces.begin();
+    while(surface != this->isosurfaces.end() &&
+            (surface->volumeID != v->ID || surface->isoValues != isoValues ||
+             surface->meshes != this->meshIsosurfaces || (surface->meshes &&
+                 surface->volumeVersion != v->getVersion())))
+        surface++;
+    if(surface != this->isosurfaces.end()) {
+        this->isosurfaces.splice(this->isosurfaces.begin(),
+                this->isosurfaces, surface);
     }
-
-    // set up lights and material if necessary
-    if(this->lights.size() == 0) {
-        // create a new directional light
-        OSPLight light = ospNewLight(this->oRenderer, "distant");
-        float direction[] = {0, -1, 1};
-        ospSet3fv(light, "direction", direction);
-        // set the apparent size of the light in degrees
-        // 0.53 approximates the Sun
-        // however this doesn't seem to change anything!
-        ospSet1f(light, "angularDiameter", 0.53);
-        ospCommit(light);
-        this->lights.push_back(light);
+    else if(this->isosurfaces.size() >= this->maxIsosurfaces &&
+            !this->meshIsosurfaces && !this->isosurfaces.back().meshes) {
+        // a full cache recycles the oldest surface in place, so sweeping
+        // through isovalues doesn't allocate new geometries and models
+        this->isosurfaces.splice(this->isosurfaces.begin(),
+                this->isosurfaces, std::prev(this->isosurfaces.end()));
+        Isosurface &oldest = this->isosurfaces.front();
+        ospRelease(oldest.oIsoValues);
+        oldest.oIsoValues = ospNewData(isoValues.size(), OSP_FLOAT,
+                v->toSampleValues(isoValues).data());
+        ospSetData(oldest.oGeometry, "isovalues", oldest.oIsoValues);
+        if(oldest.volumeID != v->ID)
+            ospSetObject(oldest.oGeometry, "volume", v->asOSPRayObject());
+        ospCommit(oldest.oGeometry);
+        ospCommit(oldest.oModel);
+        oldest.volumeID = v->ID;
+        oldest.volumeVersion = v->getVersion();
+        oldest.isoValues = isoValues;
     }
-    if(this->oMaterial == NULL) {
-        // create a new surface material with some specular highlighting
-        this->oMaterial = ospNewMaterial(this->oRenderer, "OBJMaterial");
-        float diffuse[] = {1.0, 1.0, 1.0};
-        float specular[] = {0.05, 0.05, 0.05};
-        ospSet3fv(this->oMaterial, "Kd", diffuse);
-        ospSet3fv(this->oMaterial, "Ks", specular);
-        ospSet1f(this->oMaterial, "Ns", 10);
-        ospCommit(this->oMaterial);
+    else {
+        Isosurface created;
+        created.volumeID = v->ID;
+        created.volumeVersion = v->getVersion();
+        created.isoValues = isoValues;
+        created.meshes = this->meshIsosurfaces;
+        created.oGeometry = NULL;
+        created.oIsoValues = NULL;
+        created.oModel = ospNewModel();
+        if(created.meshes) {
+            for(int i = 0; i < isoValues.size(); i++) {
+                OSPGeometry mesh = this->createMeshGeometry(v, isoValues[i]);
+                if(mesh == NULL)
+                    continue;
+                ospAddGeometry(created.oModel, mesh);
+                created.oMeshes.push_back(mesh);
+            }
+        }
+        else {
+            created.oGeometry = ospNewGeometry("isosurfaces");
+            created.oIsoValues = ospNewData(isoValues.size(), OSP_FLOAT,
+                    v->toSampleValues(isoValues).data());
+            ospSetData(created.oGeometry, "isovalues", created.oIsoValues);
+            ospSetObject(created.oGeometry, "volume", v->asOSPRayObject());
+            ospSetMaterial(created.oGeometry, this->oMaterial);
+            ospCommit(created.oGeometry);
+            ospAddGeometry(created.oModel, created.oGeometry);
+        }
+        ospCommit(created.oModel);
+        this->isosurfaces.push_front(created);
+        // the one just made always stays
+        while(this->isosurfaces.size() > this->maxIsosurfaces) {
+            this->releaseIsosurface(this->isosurfaces.back());
+            this->isosurfaces.pop_back();
+        }
     }
-    OSPData lightDataArray = ospNewData(this->lights.size(), OSP_LIGHT, this->lights.data());
-    ospCommit(lightDataArray);
-    ospSetObject(this->oRenderer, "lights", lightDataArray);
-    unsigned int aoSamples = std::max(this->samples/8, (unsigned int) 1);
-    ospSet1i(this->oRenderer, "aoSamples", aoSamples);
-    ospSet1i(this->oRenderer, "shadowsEnabled", 0);
-    ospSet1i(this->oRenderer, "oneSidedLighting", 0);
-    ospCommit(this->oRenderer);
 
-    // create an isosurface object
-    if(this->oSurface != NULL) {
-        ospRelease(this->oSurface);
-        this->oSurface = NULL;
+    // the volume may have changed since this surface was last drawn
+    Isosurface &current = this->isosurfaces.front();
+    if(current.volumeVersion != v->getVersion()) {
+        ospCommit(current.oModel);
+        current.volumeVersion = v->getVersion();
     }
-    this->oSurface = ospNewGeometry("isosurfaces");
-    OSPData isoValuesDataArray = ospNewData(isoValues.size(), OSP_FLOAT,
-            isoValues.data());
-    ospSetData(this->oSurface, "isovalues", isoValuesDataArray);
-    ospSetObject(this->oSurface, "volume", v->asOSPRayObject());
-    ospSetMaterial(this->oSurface, this->oMaterial);
-    ospCommit(this->oSurface);
 
     this->lastVolumeID = v->ID;
+    this->lastVolumeVersion = v->getVersion();
     this->lastRenderType = "isosurface";
     this->lastIsoValues = isoValues;
-    this->oModel = ospNewModel();
-    ospAddGeometry(this->oModel, this->oSurface);
-    ospCommit(this->oModel);
+    this->oModel = current.oModel;
+    this->dirty = true;
+}
+
+void Renderer::setupLighting()
+{
+    if(this->oLights != NULL)
+        return;
+
+    // create a new directional light
+    OSPLight light = ospNewLight(this->oRenderer, "distant");
+    float direction[] = {0, -1, 1};
+    ospSet3fv(light, "direction", direction);
+    // set the apparent size of the light in degrees
+    // 0.53 approximates the Sun
+    // however this doesn't seem to change anything!
+    ospSet1f(light, "angularDiameter", 0.53);
+    ospCommit(light);
+    this->lights.push_back(light);
+
+    // create a new surface material with some specular highlighting
+    this->oMaterial = ospNewMaterial(this->oRenderer, "OBJMaterial");
+    float diffuse[] = {1.0, 1.0, 1.0};
+    float specular[] = {0.05, 0.05, 0.05};
+    ospSet3fv(this->oMaterial, "Kd", diffuse);
+    ospSet3fv(this->oMaterial, "Ks", specular);
+    ospSet1f(this->oMaterial, "Ns", 10);
+    ospCommit(this->oMaterial);
+
+    this->oLights = ospNewData(this->lights.size(), OSP_LIGHT,
+            this->lights.data());
+    ospCommit(this->oLights);
+    ospSetObject(this->oRenderer, "lights", this->oLights);
+    ospSet1i(this->oRenderer, "shadowsEnabled", 0);
+    ospSet1i(this->oRenderer, "oneSidedLighting", 0);
+    this->dirty = true;
 }
 
 void Renderer::setCamera(Camera *c)
@@ -155,24 +333,28 @@ void Renderer::setCamera(Camera *c)
         // this is the same camera as the current one
         return;
     }
-    if(this->oCamera != NULL) {
-        //std::cerr << "Camera already set!" << std::endl;
-        //return;
-        ospRelease(this->oCamera);
-        this->oCamera = NULL;
-    }
 
+    // the OSPRay camera is owned by the Camera, so it isn't released here
     this->lastCameraID = c->ID;
+    this->camera = c;
+    // anything but the current version makes render() sync the camera
+    this->cameraVersion = c->getVersion() - 1;
     this->cameraWidth = c->imageWidth;
     this->cameraHeight = c->imageHeight;
     this->oCamera = c->asOSPRayObject();
+    this->dirty = true;
 }
 
 void Renderer::setSamples(unsigned int spp)
 {
     this->samples = spp;
-    ospSet1i(this->oRenderer, "spp", spp);
-    ospCommit(this->oRenderer);
+    this->dirty = true;
+}
+
+void Renderer::setProgressive(bool progressive)
+{
+    this->progressive = progressive;
+    this->dirty = true;
 }
 
 void Renderer::renderImage(std::string imageFilename)
@@ -187,10 +369,11 @@ void Renderer::renderImage(std::string imageFilename)
     this->saveImage(imageFilename, imageType);
 }
 
-void Renderer::renderToPNGObject(std::vector<unsigned char> &png)
+void Renderer::renderToPNGObject(std::vector<unsigned char> &png,
+        bool doRender)
 {
     unsigned char *colorBuffer;
-    this->renderToBuffer(&colorBuffer);
+    this->renderToBuffer(&colorBuffer, doRender);
     unsigned int error = lodepng::encode(png, colorBuffer,
             this->cameraWidth, this->cameraHeight);
     if(error) {
@@ -200,20 +383,61 @@ void Renderer::renderToPNGObject(std::vector<unsigned char> &png)
     free(colorBuffer);
 }
 
+void Renderer::renderPath(Camera *c, CameraPath *path, unsigned int numFrames,
+        std::string imageFilename)
+{
+    IMAGETYPE imageType = this->getFiletype(imageFilename);
+    if(imageType == INVALID) {
+        std::cerr << "Invalid image filetype requested!" << std::endl;
+        return;
+    }
+
+    this->setCamera(c);
+    std::vector<float> times = path->getFrameTimes(numFrames);
+
+    // frames alternate between two buffers so one can be encoded and
+    // written while the next frame renders into the other
+    std::vector<unsigned char> buffers[2];
+    std::future<void> writing;
+    for(unsigned int f = 0; f < times.size(); f++) {
+        path->apply(c, times[f]);
+        this->render();
+
+        std::vector<unsigned char> &buffer = buffers[f % 2];
+        buffer.resize(4 * this->cameraWidth * this->cameraHeight);
+        this->compositeFrame(buffer.data());
+
+        // the previous frame's writer is using the other buffer
+        if(writing.valid())
+            writing.wait();
+        writing = std::async(std::launch::async, &Renderer::writeImage,
+                frameFilename(imageFilename, f), imageType, std::cref(buffer),
+                this->cameraWidth, this->cameraHeight);
+    }
+    if(writing.valid())
+        writing.wait();
+}
+
 /*
  * Renders the OSPRay buffer to buffer and sets the width and height in 
  * their respective variables.
  */
-void Renderer::renderToBuffer(unsigned char **buffer)
+void Renderer::renderToBuffer(unsigned char **buffer, bool doRender)
+{
+    if(doRender)
+        this->render();
+    *buffer = (unsigned char *) malloc(4 * this->cameraWidth *
+            this->cameraHeight);
+    this->compositeFrame(*buffer);
+}
+
+void Renderer::compositeFrame(unsigned char *buffer)
 {
-    this->render();
     int width = this->cameraWidth;
     int height = this->cameraHeight;
     uint32_t *colorBuffer = (uint32_t *)ospMapFrameBuffer(this->oFrameBuffer,
             OSP_FB_COLOR);
     
-    *buffer = (unsigned char *) malloc(4 * width * height);
-    
     for(int j = 0; j < height; j++) {
         unsigned char *rowIn = (unsigned char*)&colorBuffer[(height-1-j)*width];
         for(int i = 0; i < width; i++) {
@@ -223,21 +447,32 @@ void Renderer::renderToBuffer(unsigned char **buffer)
                           g = rowIn[4*i + 1],
                           b = rowIn[4*i + 2];
             float a = rowIn[4*i + 3] / 255.0;
-            (*buffer)[4*index + 0] = (unsigned char) r * a +
+            buffer[4*index + 0] = (unsigned char) r * a +
                 this->backgroundColor[0] * (1.0-a);
-            (*buffer)[4*index + 1] = (unsigned char) g * a +
+            buffer[4*index + 1] = (unsigned char) g * a +
                 this->backgroundColor[1] * (1.0-a);
-            (*buffer)[4*index + 2] = (unsigned char) b * a +
+            buffer[4*index + 2] = (unsigned char) b * a +
                 this->backgroundColor[2] * (1.0-a);
-            (*buffer)[4*index + 3] = 255;
+            buffer[4*index + 3] = 255;
         }
     }
 
     ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
-    ospRelease(this->oFrameBuffer);
 }
 
 void Renderer::render()
+{
+    this->render(nullptr);
+}
+
+bool Renderer::render(std::function<bool()> cancelled)
+{
+    if(!this->commit())
+        return false;
+    return this->renderFrame(cancelled);
+}
+
+bool Renderer::commit()
 {
     //check if everything is ready for rendering
     bool exit = false;
@@ -250,23 +485,86 @@ void Renderer::render()
         exit = true;
     }
     if(exit)
-        return;
+        return false;
+
+    //pick up any changes to the volume since the last frame
+    //a recommitted volume only needs the model recommitted, not rebuilt
+    if(this->volume != NULL) {
+        this->volume->update();
+        if(this->volume->getVersion() != this->lastVolumeVersion) {
+            if(this->modelCached)
+                this->modelCache->commit(this->volume);
+            else
+                ospCommit(this->oModel);
+            if(this->lastRenderType == "isosurface")
+                this->isosurfaces.front().volumeVersion =
+                    this->volume->getVersion();
+            this->lastVolumeVersion = this->volume->getVersion();
+            this->dirty = true;
+        }
+    }
+
+    //a moved camera gets a single commit no matter how many setters ran
+    if(this->camera->getVersion() != this->cameraVersion) {
+        this->camera->commit();
+        this->cameraVersion = this->camera->getVersion();
+        this->cameraWidth = this->camera->imageWidth;
+        this->cameraHeight = this->camera->imageHeight;
+    }
+
+    //finalize the OSPRay renderer if anything changed
+    if(this->dirty) {
+        float bgColor[] = {this->backgroundColor[0]/(float)255.0,
+                           this->backgroundColor[1]/(float)255.0,
+                           this->backgroundColor[2]/(float)255.0};
+        ospSet3fv(this->oRenderer, "bgColor", bgColor);
+        //progressive frames take their samples one pass at a time
+        ospSet1i(this->oRenderer, "spp",
+                this->progressive ? 1 : this->samples);
+        if(this->lastRenderType == "isosurface") {
+            unsigned int aoSamples = std::max(this->samples/8,
+                    (unsigned int) 1);
+            ospSet1i(this->oRenderer, "aoSamples", aoSamples);
+        }
+        ospSetObject(this->oRenderer, "model", this->oModel);
+        ospSetObject(this->oRenderer, "camera", this->oCamera);
+        ospCommit(this->oRenderer);
+        this->dirty = false;
+    }
 
-    //finalize the OSPRay renderer
-    ospSetObject(this->oRenderer, "model", this->oModel);
-    ospSetObject(this->oRenderer, "camera", this->oCamera);
-    ospCommit(this->oRenderer);
-
-    //set up framebuffer
-    osp::vec2i imageSize;
-    imageSize.x = this->cameraWidth;
-    imageSize.y = this->cameraHeight;
-    //this framebuffer will be released after a single frame
-    this->oFrameBuffer = ospNewFrameBuffer(imageSize, OSP_FB_SRGBA,
-                                           OSP_FB_COLOR | OSP_FB_ACCUM);
-    ospRenderFrame(this->oFrameBuffer, this->oRenderer,
-            OSP_FB_COLOR | OSP_FB_ACCUM);
+    //set up framebuffer, reusing the last one if the size still matches
+    if(this->oFrameBuffer == NULL ||
+            this->frameBufferSize.x != this->cameraWidth ||
+            this->frameBufferSize.y != this->cameraHeight) {
+        if(this->oFrameBuffer != NULL)
+            ospRelease(this->oFrameBuffer);
+        this->frameBufferSize.x = this->cameraWidth;
+        this->frameBufferSize.y = this->cameraHeight;
+        this->oFrameBuffer = ospNewFrameBuffer(this->frameBufferSize,
+                OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM);
+    }
+    else {
+        //don't accumulate on top of the previous frame
+        ospFrameBufferClear(this->oFrameBuffer, OSP_FB_COLOR | OSP_FB_ACCUM);
+    }
+    return true;
+}
 
+bool Renderer::renderFrame(std::function<bool()> cancelled)
+{
+    if(this->oFrameBuffer == NULL)
+        return false;
+
+    unsigned int passes = 1;
+    if(this->progressive)
+        passes = std::max(this->samples, (unsigned int)1);
+    for(unsigned int pass = 0; pass < passes; pass++) {
+        if(pass > 0 && cancelled && cancelled())
+            return false;
+        ospRenderFrame(this->oFrameBuffer, this->oRenderer,
+                OSP_FB_COLOR | OSP_FB_ACCUM);
+    }
+    return true;
 }
 
 IMAGETYPE Renderer::getFiletype(std::string filename)
@@ -291,56 +589,65 @@ IMAGETYPE Renderer::getFiletype(std::string filename)
 
 void Renderer::saveImage(std::string filename, IMAGETYPE imageType)
 {
-    if(imageType == PIXMAP)
-        this->saveAsPPM(filename);
-    else if(imageType == PNG)
-        this->saveAsPNG(filename);
+    std::vector<unsigned char> rgba(4 * this->cameraWidth *
+            this->cameraHeight);
+    this->compositeFrame(rgba.data());
+    writeImage(filename, imageType, rgba, this->cameraWidth,
+            this->cameraHeight);
 }
 
-void Renderer::saveAsPPM(std::string filename)
+void Renderer::writeImage(std::string filename, IMAGETYPE imageType,
+        const std::vector<unsigned char> &rgba, int width, int height)
 {
-    int width = this->cameraWidth, height = this->cameraHeight;
-    uint32_t *colorBuffer = (uint32_t *)ospMapFrameBuffer(this->oFrameBuffer,
-            OSP_FB_COLOR);
-    //do a binary file so the PPM isn't quite so large
-    FILE *file = fopen(filename.c_str(), "wb");
-    unsigned char *rowOut = (unsigned char *)malloc(3*width);
-    fprintf(file, "P6\n%i %i\n255\n", width, height);
-
-    //the OSPRay framebuffer uses RGBA, but PPM only supports RGB
-    for(int j = 0; j < height; j++) {
-        unsigned char *rowIn = (unsigned char*)&colorBuffer[(height-1-j)*width];
-        for(int i = 0; i < width; i++) {
-            // composite rowIn RGB with background color
-            unsigned char r = rowIn[4*i + 0],
-                          g = rowIn[4*i + 1],
-                          b = rowIn[4*i + 2];
-            float a = rowIn[4*i + 3] / 255.0;
-            rowOut[3*i + 0] = (unsigned char) r * a + 
-                this->backgroundColor[0] * (1.0-a);
-            rowOut[3*i + 1] = (unsigned char) g * a + 
-                this->backgroundColor[1] * (1.0-a);
-            rowOut[3*i + 2] = (unsigned char) b * a + 
-                this->backgroundColor[2] * (1.0-a);
+    if(imageType == PNG) {
+        std::vector<unsigned char> png;
+        unsigned int error = lodepng::encode(png, rgba, width, height);
+        if(error) {
+            std::cerr << "ERROR: could not encode PNG, error " << error;
+            std::cerr << ": " << lodepng_error_text(error) << std::endl;
+            return;
         }
-        fwrite(rowOut, 3*width, sizeof(char), file);
+        lodepng::save_file(png, filename.c_str());
     }
+    else if(imageType == PIXMAP) {
+        //do a binary file so the PPM isn't quite so large
+        FILE *file = fopen(filename.c_str(), "wb");
+        if(file == NULL) {
+            std::cerr << "Could not open " << filename << std::endl;
+            return;
+        }
+        fprintf(file, "P6\n%i %i\n255\n", width, height);
+
+        //the image is already composited, PPM just drops the alpha
+        std::vector<unsigned char> rowOut(3*width);
+        for(int j = 0; j < height; j++) {
+            const unsigned char *rowIn = &rgba[4*j*width];
+            for(int i = 0; i < width; i++) {
+                rowOut[3*i + 0] = rowIn[4*i + 0];
+                rowOut[3*i + 1] = rowIn[4*i + 1];
+                rowOut[3*i + 2] = rowIn[4*i + 2];
+            }
+            fwrite(rowOut.data(), 3*width, sizeof(char), file);
+        }
 
-    fprintf(file, "\n");
-    fclose(file);
-
-    //unmap and release so OSPRay will deallocate the memory
-    //used by the framebuffer
-    ospUnmapFrameBuffer(colorBuffer, this->oFrameBuffer);
-    ospRelease(this->oFrameBuffer);
+        fprintf(file, "\n");
+        fclose(file);
+    }
 }
 
-void Renderer::saveAsPNG(std::string filename)
+std::string Renderer::frameFilename(std::string filename, unsigned int frame)
 {
-    std::vector<unsigned char> converted_image;
-    this->renderToPNGObject(converted_image);
-    //write to file
-    lodepng::save_file(converted_image, filename.c_str());
+    // insert a zero-padded frame number before the extension, or at the
+    // end without one, dots in directory names don't count
+    std::string::size_type index = filename.rfind('.');
+    std::string::size_type slash = filename.rfind('/');
+    if(index == std::string::npos ||
+            (slash != std::string::npos && index < slash))
+        index = filename.length();
+    std::string number = std::to_string(frame);
+    if(number.length() < 4)
+        number.insert(0, 4 - number.length(), '0');
+    return filename.substr(0, index) + number + filename.substr(index);
 }
 
 }
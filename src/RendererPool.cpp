@@ -0,0 +1,160 @@
+#include "RendererPool.h"
+#include "ModelCache.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace pbnj {
+
+RendererPool::RendererPool(unsigned int numRenderers) :
+    framesInFlight(0), activeRenders(0)
+{
+    if(numRenderers == 0)
+        numRenderers = getNumThreads();
+    this->maxConcurrent = getNumThreads();
+
+    for(unsigned int r = 0; r < numRenderers; r++) {
+        Renderer *renderer = new Renderer();
+        renderer->setModelCache(&this->modelCache);
+        this->renderers.push_back(renderer);
+        this->rendererLocks.push_back(new std::mutex());
+        this->sessionCounts.push_back(0);
+    }
+}
+
+RendererPool::~RendererPool()
+{
+    // renderers hand their models back to the cache, so they go first
+    for(int r = 0; r < this->renderers.size(); r++) {
+        delete this->renderers[r];
+        delete this->rendererLocks[r];
+    }
+}
+
+void RendererPool::setMaxConcurrent(unsigned int renders)
+{
+    std::lock_guard<std::mutex> guard(this->renderLock);
+    this->maxConcurrent = std::max(renders, (unsigned int)1);
+}
+
+void RendererPool::assign(unsigned long int sessionID)
+{
+    std::lock_guard<std::mutex> guard(this->sessionLock);
+    if(this->sessions.count(sessionID) > 0)
+        return;
+
+    unsigned int least = std::min_element(this->sessionCounts.begin(),
+            this->sessionCounts.end()) - this->sessionCounts.begin();
+    this->sessions[sessionID] = least;
+    this->sessionCounts[least]++;
+}
+
+void RendererPool::unassign(unsigned long int sessionID)
+{
+    std::lock_guard<std::mutex> guard(this->sessionLock);
+    auto found = this->sessions.find(sessionID);
+    if(found == this->sessions.end())
+        return;
+    this->sessionCounts[found->second]--;
+    this->sessions.erase(found);
+}
+
+Renderer *RendererPool::acquire(unsigned long int sessionID)
+{
+    this->assign(sessionID);
+    unsigned int r;
+    {
+        std::lock_guard<std::mutex> guard(this->sessionLock);
+        r = this->sessions[sessionID];
+    }
+    this->rendererLocks[r]->lock();
+    return this->renderers[r];
+}
+
+void RendererPool::release(unsigned long int sessionID)
+{
+    unsigned int r;
+    {
+        std::lock_guard<std::mutex> guard(this->sessionLock);
+        auto found = this->sessions.find(sessionID);
+        if(found == this->sessions.end()) {
+            std::cerr << "WARNING: released a renderer for an unknown ";
+            std::cerr << "session" << std::endl;
+            return;
+        }
+        r = found->second;
+    }
+    this->rendererLocks[r]->unlock();
+}
+
+bool RendererPool::render(Renderer *r, std::function<bool()> cancelled)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->objectLock);
+        if(!this->commit(r))
+            return false;
+    }
+    bool finished = this->renderFrame(r, cancelled);
+    this->finishFrame();
+    return finished;
+}
+
+bool RendererPool::commit(Renderer *r)
+{
+    if(!r->commit())
+        return false;
+    this->framesInFlight++;
+    return true;
+}
+
+bool RendererPool::renderFrame(Renderer *r, std::function<bool()> cancelled)
+{
+    {
+        std::unique_lock<std::mutex> guard(this->renderLock);
+        this->renderSlots.wait(guard, [this]() {
+            return this->activeRenders < this->maxConcurrent;
+        });
+        this->activeRenders++;
+    }
+    bool finished = r->renderFrame(cancelled);
+    {
+        std::lock_guard<std::mutex> guard(this->renderLock);
+        this->activeRenders--;
+    }
+    this->renderSlots.notify_one();
+    return finished;
+}
+
+void RendererPool::finishFrame()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->objectLock);
+        this->framesInFlight--;
+    }
+    this->framesDone.notify_all();
+}
+
+void RendererPool::waitForFrames(std::unique_lock<std::mutex> &objectGuard)
+{
+    this->framesDone.wait(objectGuard, [this]() {
+        return this->framesInFlight == 0;
+    });
+}
+
+std::mutex &RendererPool::getObjectLock()
+{
+    return this->objectLock;
+}
+
+ModelCache *RendererPool::getModelCache()
+{
+    return &this->modelCache;
+}
+
+unsigned int RendererPool::getNumRenderers()
+{
+    return this->renderers.size();
+}
+
+}
@@ -0,0 +1,305 @@
+#include "Scene.h"
+#include "Camera.h"
+#include "Configuration.h"
+#include "Renderer.h"
+#include "SharedVolumeStore.h"
+#include "TimeSeries.h"
+#include "TransferFunction.h"
+#include "Volume.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace pbnj {
+
+Scene::Scene(Configuration *config) :
+    volume(NULL), timeSeries(NULL), timestep(0), sharedStore(NULL)
+{
+    this->config = new Configuration(*config);
+    this->dataIdentity = this->config->getDataIdentity();
+
+    this->camera = new Camera(this->config->imageWidth,
+            this->config->imageHeight);
+    this->renderer = new Renderer();
+    this->renderer->setCamera(this->camera);
+    this->applyCamera();
+
+    this->loadData();
+    this->applyRenderer();
+}
+
+Scene::~Scene()
+{
+    delete this->renderer;
+    delete this->camera;
+    if(this->timeSeries != NULL)
+        delete this->timeSeries;
+    else
+        delete this->volume;
+    delete this->sharedStore;
+    delete this->config;
+}
+
+unsigned int Scene::apply(Configuration *config)
+{
+    unsigned int changes = this->config->diff(config);
+    // a rewritten file keeps its name but still needs to be reloaded,
+    // while a symlink or a relative path to the same file doesn't
+    std::string identity = config->getDataIdentity();
+    if(identity != this->dataIdentity)
+        changes |= CHANGE_DATA;
+
+    delete this->config;
+    this->config = new Configuration(*config);
+
+    if(changes & CHANGE_CAMERA)
+        this->applyCamera();
+
+    if(changes & CHANGE_DATA) {
+        // a new volume picks up the transfer function, range and
+        // renderer settings as it loads
+        if(this->loadData())
+            this->dataIdentity = identity;
+        else
+            changes &= ~CHANGE_DATA;
+    }
+    else {
+        if(changes & CHANGE_TRANSFERFUNCTION)
+            this->applyTransferFunction();
+        if(changes & CHANGE_RANGE)
+            this->applyRange();
+    }
+
+    if(changes & CHANGE_RENDERER)
+        this->applyRenderer();
+
+    return changes;
+}
+
+void Scene::setTimestep(unsigned int index, bool fullResolution)
+{
+    if(this->timeSeries == NULL)
+        return;
+    if(index >= this->timeSeries->getLength()) {
+        std::cerr << "WARNING: timestep " << index << " is out of range";
+        std::cerr << std::endl;
+        return;
+    }
+
+    // the renderer keeps using the volume, so it mustn't be evicted
+    this->timeSeries->pin(index);
+    this->timeSeries->unpin(this->timestep);
+    this->timestep = index;
+    if(fullResolution)
+        this->volume = this->timeSeries->getFullResolutionVolume(index);
+    else
+        this->volume = this->timeSeries->getVolume(index);
+    this->setRenderTarget();
+}
+
+void Scene::setTime(float time)
+{
+    if(this->timeSeries == NULL)
+        return;
+
+    Volume *blended = this->timeSeries->getInterpolatedVolume(time);
+    if(blended == NULL)
+        return;
+    unsigned int index = std::min((unsigned int)std::max(0.0f, time),
+            this->timeSeries->getLength() - 1);
+    this->timeSeries->pin(index);
+    this->timeSeries->unpin(this->timestep);
+    this->timestep = index;
+    this->volume = blended;
+    this->setRenderTarget();
+}
+
+bool Scene::loadData()
+{
+    Configuration *c = this->config;
+    Volume *newVolume = NULL;
+    TimeSeries *newSeries = NULL;
+
+    SharedVolumeStore *store = NULL;
+    if(c->sharedMemory > 0) {
+        unsigned long int maxBytes = c->sharedMemory * 1073741824L;
+        if(this->sharedStore == NULL)
+            this->sharedStore = new SharedVolumeStore(maxBytes);
+        else
+            this->sharedStore->setMaxBytes(maxBytes);
+        if(this->sharedStore->isOpen())
+            store = this->sharedStore;
+    }
+
+    switch(c->getConfigState()) {
+        case ERROR_NODATA:
+            std::cerr << "ERROR: No data filename(s) provided";
+            std::cerr << std::endl;
+            return false;
+        case ERROR_MULTISET:
+            std::cerr << "ERROR: Multiple filename types requested";
+            std::cerr << std::endl;
+            return false;
+        case SINGLE_NOVAR:
+            newVolume = new Volume(c->dataFilename, c->dataXDim, c->dataYDim,
+                    c->dataZDim, false, false, c->approximateStats, NULL,
+                    c->downsample, c->decimation, store);
+            break;
+        case SINGLE_VAR:
+            newVolume = new Volume(c->dataFilename, c->dataVariable,
+                    c->dataXDim, c->dataYDim, c->dataZDim, false, false,
+                    c->approximateStats, NULL, c->downsample, c->decimation,
+                    store);
+            break;
+        case MULTI_NOVAR:
+            newSeries = new TimeSeries(c->globbedFilenames, c->dataXDim,
+                    c->dataYDim, c->dataZDim);
+            break;
+        case MULTI_VAR:
+            newSeries = new TimeSeries(c->globbedFilenames, c->dataVariable,
+                    c->dataXDim, c->dataYDim, c->dataZDim);
+    }
+
+    // keep the old data until the renderer has let go of it
+    Volume *oldVolume = this->volume;
+    TimeSeries *oldSeries = this->timeSeries;
+
+    this->timeSeries = newSeries;
+    if(newSeries != NULL) {
+        newSeries->setMemoryMapping(true);
+        newSeries->setApproximateStatistics(c->approximateStats);
+        newSeries->setDownsample(c->downsample, c->decimation);
+        newSeries->setQuantization(c->quantizeBits);
+        newSeries->setSharedStore(store);
+        newSeries->setRangePercentiles(c->rangeLowPercentile,
+                c->rangeHighPercentile);
+        if(c->valueRange.size() == 2)
+            newSeries->setValueRange(c->valueRange[0], c->valueRange[1]);
+        if(this->timestep >= newSeries->getLength())
+            this->timestep = 0;
+        this->applyTransferFunction();
+        newSeries->pin(this->timestep);
+        newVolume = newSeries->getVolume(this->timestep);
+    }
+    this->volume = newVolume;
+    if(newSeries == NULL) {
+        this->applyTransferFunction();
+        this->applyRange();
+    }
+    this->setRenderTarget();
+
+    if(oldSeries != NULL)
+        delete oldSeries;
+    else if(oldVolume != NULL)
+        delete oldVolume;
+    return true;
+}
+
+void Scene::applyTransferFunction()
+{
+    // an empty map in the configuration means the default one
+    std::vector<float> &colors = this->config->colorMap.empty() ?
+        blackToWhite : this->config->colorMap;
+    std::vector<float> &opacities = this->config->opacityMap.empty() ?
+        ramp : this->config->opacityMap;
+
+    // changes land in the transfer function and are committed with the
+    // next frame
+    if(this->timeSeries != NULL) {
+        this->timeSeries->setColorMap(colors);
+        this->timeSeries->setOpacityMap(opacities);
+        this->timeSeries->setOpacityAttenuation(
+                this->config->opacityAttenuation);
+    }
+    else if(this->volume != NULL) {
+        this->volume->setColorMap(colors);
+        this->volume->setOpacityMap(opacities);
+        this->volume->attenuateOpacity(this->config->opacityAttenuation);
+    }
+}
+
+void Scene::applyRange()
+{
+    if(this->timeSeries != NULL) {
+        // the resident timesteps set the range again, nothing is reloaded
+        this->timeSeries->getTransferFunction()->unfixRange();
+        this->timeSeries->setRangePercentiles(
+                this->config->rangeLowPercentile,
+                this->config->rangeHighPercentile);
+        if(this->config->valueRange.size() == 2)
+            this->timeSeries->setValueRange(this->config->valueRange[0],
+                    this->config->valueRange[1]);
+        return;
+    }
+    // nothing loaded yet, e.g. the first configuration had no data
+    if(this->volume == NULL)
+        return;
+    TransferFunction *tf = this->volume->getTransferFunction();
+    tf->unfixRange();
+    this->volume->setRangePercentiles(this->config->rangeLowPercentile,
+            this->config->rangeHighPercentile);
+    if(this->config->valueRange.size() == 2)
+        tf->fixRange(this->config->valueRange[0],
+                this->config->valueRange[1]);
+}
+
+void Scene::applyCamera()
+{
+    Configuration *c = this->config;
+    if(this->camera->imageWidth != c->imageWidth ||
+            this->camera->imageHeight != c->imageHeight)
+        this->camera->setImageSize(c->imageWidth, c->imageHeight);
+    this->camera->setPosition(c->cameraX, c->cameraY, c->cameraZ);
+    this->camera->setUpVector(c->cameraUpX, c->cameraUpY, c->cameraUpZ);
+}
+
+void Scene::applyRenderer()
+{
+    this->renderer->setBackgroundColor(this->config->bgColor);
+    this->renderer->setSamples(this->config->samples);
+    this->renderer->setIsosurfaceMeshes(this->config->isosurfaceMeshes);
+    this->setRenderTarget();
+}
+
+void Scene::setRenderTarget()
+{
+    // nothing loaded yet, e.g. the first configuration had no data
+    if(this->volume == NULL)
+        return;
+
+    // the renderer keeps its model if neither volume nor mode changed
+    if(this->config->isosurfaceValues.empty())
+        this->renderer->setVolume(this->volume);
+    else
+        this->renderer->setIsosurface(this->volume,
+                this->config->isosurfaceValues);
+}
+
+Configuration *Scene::getConfiguration()
+{
+    return this->config;
+}
+
+Volume *Scene::getVolume()
+{
+    return this->volume;
+}
+
+TimeSeries *Scene::getTimeSeries()
+{
+    return this->timeSeries;
+}
+
+Camera *Scene::getCamera()
+{
+    return this->camera;
+}
+
+Renderer *Scene::getRenderer()
+{
+    return this->renderer;
+}
+
+}
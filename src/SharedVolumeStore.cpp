@@ -0,0 +1,413 @@
+#include "SharedVolumeStore.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pbnj {
+
+static const uint64_t STORE_MAGIC = 0x32534f54534a4e42ULL; // "BNJSTOS2"
+static const int MAX_ENTRIES = 256;
+// longer keys, e.g. from very long paths, aren't shared
+static const int MAX_KEY = 1024;
+// references to one segment at a time, across every process
+static const int MAX_HOLDERS = 64;
+
+enum ENTRYSTATE {ENTRY_EMPTY, ENTRY_LOADING, ENTRY_READY};
+
+struct SharedVolumeStore::Header {
+    // written last by the process that creates the store
+    std::atomic<uint64_t> magic;
+    pthread_mutex_t lock;
+    uint64_t maxBytes;
+    uint64_t usedBytes;
+    uint64_t clock;
+    struct {
+        int state;
+        // the process filling a loading entry, in case it dies
+        pid_t loader;
+        // one process per reference, 0 for none, so a process that dies
+        // holding some doesn't keep the segment forever
+        pid_t holders[MAX_HOLDERS];
+        uint64_t bytes;
+        uint64_t lastUse;
+        // of the whole key, which names the segment
+        uint64_t hash;
+        char key[MAX_KEY];
+    } entries[MAX_ENTRIES];
+};
+
+SharedVolumeStore::SharedVolumeStore(unsigned long int maxBytes,
+        std::string name) :
+    name(name), header(NULL)
+{
+    bool created = true;
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd == -1 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if(fd == -1) {
+        std::cerr << "WARNING: could not open shared memory " << name;
+        std::cerr << ": " << strerror(errno) << std::endl;
+        return;
+    }
+
+    if(created && ftruncate(fd, sizeof(Header)) == -1) {
+        std::cerr << "WARNING: could not size shared memory " << name;
+        std::cerr << std::endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return;
+    }
+    // whoever created it may still be sizing it
+    struct stat info;
+    for(int tries = 0; !created && tries < 1000; tries++) {
+        if(fstat(fd, &info) == 0 && info.st_size >= sizeof(Header))
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    void *mapped = mmap(NULL, sizeof(Header), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        std::cerr << "WARNING: could not map shared memory " << name;
+        std::cerr << std::endl;
+        return;
+    }
+    this->header = (Header *)mapped;
+
+    if(created) {
+        // a robust mutex survives a process dying while holding it
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&this->header->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        this->header->maxBytes = maxBytes;
+        this->header->usedBytes = 0;
+        this->header->clock = 0;
+        memset(this->header->entries, 0, sizeof(this->header->entries));
+        this->header->magic.store(STORE_MAGIC);
+    }
+    else {
+        for(int tries = 0; tries < 1000 &&
+                this->header->magic.load() != STORE_MAGIC; tries++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if(this->header->magic.load() != STORE_MAGIC) {
+            std::cerr << "WARNING: shared memory " << name;
+            std::cerr << " was never set up" << std::endl;
+            munmap(this->header, sizeof(Header));
+            this->header = NULL;
+        }
+    }
+}
+
+SharedVolumeStore::~SharedVolumeStore()
+{
+    while(!this->mappings.empty())
+        this->release(this->mappings.begin()->first);
+    if(this->header != NULL)
+        munmap(this->header, sizeof(Header));
+}
+
+bool SharedVolumeStore::isOpen()
+{
+    return this->header != NULL;
+}
+
+void SharedVolumeStore::lock()
+{
+    // the previous owner died, the table itself is only changed in small
+    // steps that leave it usable
+    if(pthread_mutex_lock(&this->header->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&this->header->lock);
+}
+
+void SharedVolumeStore::unlock()
+{
+    pthread_mutex_unlock(&this->header->lock);
+}
+
+void SharedVolumeStore::setMaxBytes(unsigned long int maxBytes)
+{
+    if(this->header == NULL)
+        return;
+    this->lock();
+    this->header->maxBytes = maxBytes;
+    this->makeRoom(0);
+    this->unlock();
+}
+
+unsigned long int SharedVolumeStore::getMaxBytes()
+{
+    return this->header == NULL ? 0 : this->header->maxBytes;
+}
+
+unsigned long int SharedVolumeStore::getUsedBytes()
+{
+    return this->header == NULL ? 0 : this->header->usedBytes;
+}
+
+static uint64_t hashKey(std::string key)
+{
+    // FNV-1a, the full key is checked against the table
+    uint64_t hash = 14695981039346656037ULL;
+    for(int i = 0; i < key.length(); i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string SharedVolumeStore::getSegmentName(uint64_t hash)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return this->name + "-" + hex;
+}
+
+int SharedVolumeStore::findEntry(std::string key)
+{
+    for(int e = 0; e < MAX_ENTRIES; e++)
+        if(this->header->entries[e].state != ENTRY_EMPTY &&
+                key == this->header->entries[e].key)
+            return e;
+    return -1;
+}
+
+static bool isAlive(pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+int SharedVolumeStore::countReferences(int entry)
+{
+    int references = 0;
+    pid_t *holders = this->header->entries[entry].holders;
+    for(int h = 0; h < MAX_HOLDERS; h++) {
+        if(holders[h] != 0 && !isAlive(holders[h]))
+            holders[h] = 0;
+        if(holders[h] != 0)
+            references++;
+    }
+    return references;
+}
+
+bool SharedVolumeStore::addReference(int entry)
+{
+    pid_t *holders = this->header->entries[entry].holders;
+    for(int pass = 0; pass < 2; pass++) {
+        for(int h = 0; h < MAX_HOLDERS; h++) {
+            if(holders[h] == 0) {
+                holders[h] = getpid();
+                return true;
+            }
+        }
+        // make space by dropping any dead holders
+        this->countReferences(entry);
+    }
+    return false;
+}
+
+void SharedVolumeStore::removeReference(int entry)
+{
+    pid_t *holders = this->header->entries[entry].holders;
+    for(int h = 0; h < MAX_HOLDERS; h++) {
+        if(holders[h] == getpid()) {
+            holders[h] = 0;
+            return;
+        }
+    }
+}
+
+void SharedVolumeStore::removeEntry(int entry)
+{
+    shm_unlink(this->getSegmentName(
+                this->header->entries[entry].hash).c_str());
+    this->header->usedBytes -= this->header->entries[entry].bytes;
+    this->header->entries[entry].state = ENTRY_EMPTY;
+    memset(this->header->entries[entry].holders, 0,
+            sizeof(this->header->entries[entry].holders));
+}
+
+bool SharedVolumeStore::makeRoom(size_t bytes)
+{
+    // unreferenced segments go, least recently used first, processes
+    // still mapping one keep their pages until they unmap it
+    while(this->header->usedBytes + bytes > this->header->maxBytes) {
+        int oldest = -1;
+        for(int e = 0; e < MAX_ENTRIES; e++) {
+            if(this->header->entries[e].state != ENTRY_READY ||
+                    this->countReferences(e) > 0)
+                continue;
+            if(oldest == -1 || this->header->entries[e].lastUse <
+                    this->header->entries[oldest].lastUse)
+                oldest = e;
+        }
+        if(oldest == -1)
+            return false;
+        this->removeEntry(oldest);
+    }
+    return true;
+}
+
+const void *SharedVolumeStore::acquire(std::string key, size_t bytes,
+        std::function<bool(void *)> fill)
+{
+    if(this->header == NULL || bytes == 0 || key.length() >= MAX_KEY)
+        return NULL;
+    uint64_t hash = hashKey(key);
+    std::string segmentName = this->getSegmentName(hash);
+
+    int entry;
+    bool filling = false;
+    while(true) {
+        this->lock();
+        entry = this->findEntry(key);
+        if(entry != -1 &&
+                this->header->entries[entry].state == ENTRY_LOADING &&
+                !isAlive(this->header->entries[entry].loader)) {
+            // whoever was filling it is gone
+            this->removeEntry(entry);
+            entry = -1;
+        }
+
+        if(entry != -1 &&
+                this->header->entries[entry].state == ENTRY_READY) {
+            if(this->header->entries[entry].bytes != bytes) {
+                this->unlock();
+                std::cerr << "WARNING: shared data for " << key;
+                std::cerr << " has a different size" << std::endl;
+                return NULL;
+            }
+            if(!this->addReference(entry)) {
+                this->unlock();
+                return NULL;
+            }
+            this->header->entries[entry].lastUse = ++this->header->clock;
+            this->unlock();
+            break;
+        }
+
+        if(entry == -1) {
+            // claim a slot and the space, then fill it outside the lock
+            for(int e = 0; e < MAX_ENTRIES && entry == -1; e++)
+                if(this->header->entries[e].state == ENTRY_EMPTY)
+                    entry = e;
+            if(entry == -1 || !this->makeRoom(bytes)) {
+                this->unlock();
+                return NULL;
+            }
+            this->header->entries[entry].state = ENTRY_LOADING;
+            this->header->entries[entry].loader = getpid();
+            this->addReference(entry);
+            this->header->entries[entry].bytes = bytes;
+            this->header->entries[entry].lastUse = ++this->header->clock;
+            this->header->entries[entry].hash = hash;
+            strcpy(this->header->entries[entry].key, key.c_str());
+            this->header->usedBytes += bytes;
+            this->unlock();
+            filling = true;
+            break;
+        }
+
+        // another process is filling it
+        this->unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    void *mapped = MAP_FAILED;
+    if(filling) {
+        shm_unlink(segmentName.c_str());
+        int fd = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR,
+                0600);
+        // the pages are reserved up front, a sparse segment would raise
+        // SIGBUS while filling it once the shared memory ran out, e.g. in
+        // a container with a small /dev/shm
+        if(fd != -1) {
+            if(posix_fallocate(fd, 0, bytes) == 0)
+                mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+            close(fd);
+        }
+        bool filled = mapped != MAP_FAILED && fill(mapped);
+        this->lock();
+        if(filled) {
+            // readers only ever get read-only pages
+            mprotect(mapped, bytes, PROT_READ);
+            this->header->entries[entry].state = ENTRY_READY;
+            this->unlock();
+        }
+        else {
+            this->removeEntry(entry);
+            this->unlock();
+            if(mapped != MAP_FAILED)
+                munmap(mapped, bytes);
+            return NULL;
+        }
+    }
+    else {
+        int fd = shm_open(segmentName.c_str(), O_RDONLY, 0600);
+        if(fd != -1) {
+            mapped = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+        }
+        if(mapped == MAP_FAILED) {
+            this->lock();
+            this->removeReference(entry);
+            this->unlock();
+            return NULL;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(this->mappingLock);
+    this->mappings[mapped] = {bytes, entry};
+    return mapped;
+}
+
+void SharedVolumeStore::release(const void *data)
+{
+    Mapping mapping;
+    {
+        std::lock_guard<std::mutex> guard(this->mappingLock);
+        auto found = this->mappings.find(data);
+        if(found == this->mappings.end())
+            return;
+        mapping = found->second;
+        this->mappings.erase(found);
+    }
+
+    munmap((void *)data, mapping.bytes);
+    this->lock();
+    this->removeReference(mapping.entry);
+    this->unlock();
+}
+
+void SharedVolumeStore::purge()
+{
+    if(this->header == NULL)
+        return;
+    this->lock();
+    for(int e = 0; e < MAX_ENTRIES; e++)
+        if(this->header->entries[e].state == ENTRY_READY &&
+                this->countReferences(e) == 0)
+            this->removeEntry(e);
+    this->unlock();
+}
+
+}
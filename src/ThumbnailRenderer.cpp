@@ -0,0 +1,426 @@
+#include "ThumbnailRenderer.h"
+#include "Camera.h"
+#include "Configuration.h"
+#include "DataFile.h"
+#include "Renderer.h"
+#include "TransferFunction.h"
+#include "Volume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/sysinfo.h>
+
+namespace pbnj {
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+ThumbnailRenderer::ThumbnailRenderer(Configuration *config) :
+    downsample(0), decimation(DECIMATE_AVERAGE), loadTime(0.0),
+    renderTime(0.0), totalTime(0.0)
+{
+    this->config = new Configuration(*config);
+
+    std::vector<std::string> filenames = config->globbedFilenames;
+    if(filenames.empty()) {
+        filenames.push_back(config->dataFilename);
+        this->imageFilenames.push_back(config->imageFilename);
+    }
+    else {
+        for(int t = 0; t < filenames.size(); t++)
+            this->imageFilenames.push_back(Renderer::frameFilename(
+                        config->imageFilename, t));
+    }
+    this->images.resize(filenames.size());
+
+    this->imageWidth = 128;
+    this->imageHeight = 128;
+    if(config->imageWidth > 0 && config->imageHeight > 0)
+        this->imageHeight = std::max(1, this->imageWidth *
+                config->imageHeight / config->imageWidth);
+
+    // same default budget as a TimeSeries
+    struct sysinfo systemInfo;
+    sysinfo(&systemInfo);
+    this->maxMemory = systemInfo.mem_unit * systemInfo.freeram * 0.5;
+    // loaders mostly wait on the disk, renderers each leave some of the
+    // cores idle on small frames
+    this->numWorkers = std::min(getNumThreads(), (unsigned int)4);
+    this->numRenderers = std::min(getNumThreads(), (unsigned int)4);
+}
+
+ThumbnailRenderer::~ThumbnailRenderer()
+{
+    delete this->config;
+}
+
+void ThumbnailRenderer::setImageSize(int width, int height)
+{
+    this->imageWidth = std::max(width, 1);
+    this->imageHeight = std::max(height, 1);
+}
+
+void ThumbnailRenderer::setDownsample(unsigned int factor,
+        DECIMATION decimation)
+{
+    this->downsample = std::max(factor, (unsigned int)1);
+    this->decimation = decimation;
+}
+
+void ThumbnailRenderer::setMaxMemory(unsigned int gigabytes)
+{
+    this->maxMemory = gigabytes * 1073741824L;
+}
+
+void ThumbnailRenderer::setNumWorkers(unsigned int workers)
+{
+    this->numWorkers = std::max(workers, (unsigned int)1);
+}
+
+void ThumbnailRenderer::setNumRenderers(unsigned int renderers)
+{
+    this->numRenderers = std::max(renderers, (unsigned int)1);
+}
+
+void ThumbnailRenderer::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    Configuration *c = this->config;
+    std::vector<std::string> filenames = c->globbedFilenames;
+    if(filenames.empty())
+        filenames.push_back(c->dataFilename);
+    unsigned int length = filenames.size();
+
+    IMAGETYPE imageType = Renderer::getFiletype(c->imageFilename);
+    if(imageType == INVALID) {
+        std::cerr << "Invalid image filetype requested!" << std::endl;
+        return;
+    }
+
+    // NetCDF files have their own dimensions, only raw ones use the
+    // configured ones
+    DataFile dimensions(c->dataXDim, c->dataYDim, c->dataZDim);
+    if(!dimensions.readDimensions(filenames[0], c->dataVariable)) {
+        std::cerr << "ERROR: could not read " << filenames[0] << std::endl;
+        return;
+    }
+    int x = dimensions.xDim, y = dimensions.yDim, z = dimensions.zDim;
+
+    // a voxel or so per pixel is all a thumbnail can show
+    unsigned long int factor = this->downsample;
+    if(factor == 0) {
+        int voxels = std::max(x, std::max(y, z));
+        int pixels = std::max(this->imageWidth, this->imageHeight);
+        factor = std::max(1, voxels / pixels);
+    }
+    unsigned long int bytes = ((x + factor - 1) / factor) *
+        ((y + factor - 1) / factor) * ((z + factor - 1) / factor) *
+        sizeof(float);
+
+    struct Loaded {
+        unsigned int timestep;
+        DataFile *dataFile;
+    };
+
+    std::mutex lock;
+    std::condition_variable changed;
+    unsigned long int resident = 0;
+    unsigned int nextTimestep = 0;
+    unsigned int taken = 0;
+    std::deque<Loaded> loaded;
+    this->loadTime = 0.0;
+    this->renderTime = 0.0;
+
+    // every thumbnail is colored over the same range so the montage can
+    // compare timesteps, either the configured one or the one all of them
+    // cover, found by a strided read of each before any are rendered
+    float minimum = INFINITY, maximum = -INFINITY;
+    if(c->valueRange.size() == 2) {
+        minimum = c->valueRange[0];
+        maximum = c->valueRange[1];
+    }
+    else {
+        auto rangeTimesteps = [&]() {
+            while(true) {
+                unsigned int t;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if(nextTimestep >= length)
+                        return;
+                    t = nextTimestep++;
+                }
+
+                auto loadStart = std::chrono::steady_clock::now();
+                DataFile dataFile(c->dataXDim, c->dataYDim, c->dataZDim);
+                dataFile.loadFromFile(filenames[t], c->dataVariable, false,
+                        false, factor, DECIMATE_STRIDE);
+                float low = 0.0, high = 0.0;
+                if(dataFile.data != NULL) {
+                    dataFile.calculateStatistics();
+                    low = c->rangeLowPercentile > 0.0 ?
+                        dataFile.getPercentile(c->rangeLowPercentile) :
+                        dataFile.minVal;
+                    high = c->rangeHighPercentile < 100.0 ?
+                        dataFile.getPercentile(c->rangeHighPercentile) :
+                        dataFile.maxVal;
+                }
+                double seconds = secondsSince(loadStart);
+
+                std::lock_guard<std::mutex> guard(lock);
+                this->loadTime += seconds;
+                if(dataFile.data != NULL) {
+                    minimum = std::min(minimum, low);
+                    maximum = std::max(maximum, high);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for(unsigned int w = 0; w < this->numWorkers; w++)
+            workers.push_back(std::thread(rangeTimesteps));
+        for(int w = 0; w < workers.size(); w++)
+            workers[w].join();
+        nextTimestep = 0;
+        // nothing loaded, the thumbnails will all fail anyway
+        if(minimum > maximum) {
+            minimum = 0.0;
+            maximum = 1.0;
+        }
+    }
+
+    // an empty map in the configuration means the default one
+    TransferFunction *transferFunction = new TransferFunction();
+    transferFunction->setColorMap(c->colorMap.empty() ? blackToWhite :
+            c->colorMap);
+    transferFunction->setOpacityMap(c->opacityMap.empty() ? ramp :
+            c->opacityMap);
+    transferFunction->attenuateOpacity(c->opacityAttenuation);
+    transferFunction->fixRange(minimum, maximum);
+
+    auto loadTimesteps = [&]() {
+        while(true) {
+            unsigned int t;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if(nextTimestep >= length)
+                    return;
+                t = nextTimestep++;
+                // a timestep bigger than the whole budget still gets its
+                // turn once nothing else is resident
+                changed.wait(guard, [&]() {
+                    return resident == 0 ||
+                        resident + bytes <= this->maxMemory;
+                });
+                resident += bytes;
+            }
+
+            auto loadStart = std::chrono::steady_clock::now();
+            DataFile *dataFile = new DataFile(c->dataXDim, c->dataYDim,
+                    c->dataZDim);
+            dataFile->loadFromFile(filenames[t], c->dataVariable, false,
+                    false, factor, this->decimation);
+            if(dataFile->data == NULL) {
+                delete dataFile;
+                dataFile = NULL;
+            }
+            else
+                dataFile->calculateStatistics();
+            double seconds = secondsSince(loadStart);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                this->loadTime += seconds;
+                loaded.push_back({t, dataFile});
+            }
+            changed.notify_all();
+        }
+    };
+
+    // OSPRay objects are created, changed and released one thread at a
+    // time, only the frames render concurrently, each renderer into its
+    // own frame buffer, as RendererPool does
+    std::mutex objectLock;
+
+    auto renderTimesteps = [&]() {
+        Renderer *renderer = NULL;
+        Camera *camera = NULL;
+        while(true) {
+            Loaded next;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() {
+                    return !loaded.empty() || taken >= length;
+                });
+                if(loaded.empty())
+                    break;
+                next = loaded.front();
+                loaded.pop_front();
+                taken++;
+                // wake the other renderers if there is nothing left
+                if(taken >= length)
+                    changed.notify_all();
+            }
+
+            if(next.dataFile == NULL) {
+                std::cerr << "ERROR: could not load ";
+                std::cerr << filenames[next.timestep] << std::endl;
+            }
+            else {
+                auto renderStart = std::chrono::steady_clock::now();
+                Volume *volume;
+                bool committed;
+                {
+                    std::lock_guard<std::mutex> objectGuard(objectLock);
+                    if(renderer == NULL) {
+                        renderer = new Renderer();
+                        // the surfaces of finished timesteps aren't needed
+                        renderer->setIsosurfaceCacheSize(1);
+                        renderer->setBackgroundColor(c->bgColor);
+                        renderer->setSamples(c->samples);
+                        renderer->setIsosurfaceMeshes(c->isosurfaceMeshes);
+                        camera = new Camera(this->imageWidth,
+                                this->imageHeight);
+                        // downsampled volumes fill the same space, so the
+                        // configured camera still frames them
+                        camera->setPosition(c->cameraX, c->cameraY,
+                                c->cameraZ);
+                        camera->setUpVector(c->cameraUpX, c->cameraUpY,
+                                c->cameraUpZ);
+                        renderer->setCamera(camera);
+                    }
+
+                    // the volume owns the data file from here on
+                    volume = new Volume(next.dataFile, transferFunction);
+                    if(c->isosurfaceValues.empty())
+                        renderer->setVolume(volume);
+                    else
+                        renderer->setIsosurface(volume, c->isosurfaceValues);
+                    committed = renderer->commit();
+                }
+
+                std::vector<unsigned char> image;
+                if(committed) {
+                    renderer->renderFrame();
+                    unsigned char *buffer;
+                    renderer->renderToBuffer(&buffer, false);
+                    image.assign(buffer, buffer +
+                            4 * this->imageWidth * this->imageHeight);
+                    free(buffer);
+                }
+
+                {
+                    std::lock_guard<std::mutex> objectGuard(objectLock);
+                    renderer->detachVolume();
+                    delete volume;
+                }
+
+                // encoding overlaps with the other renderers' frames
+                if(!image.empty())
+                    Renderer::writeImage(this->imageFilenames[next.timestep],
+                            imageType, image, this->imageWidth,
+                            this->imageHeight);
+                double seconds = secondsSince(renderStart);
+
+                std::lock_guard<std::mutex> guard(lock);
+                this->images[next.timestep].swap(image);
+                this->renderTime += seconds;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                resident -= bytes;
+            }
+            changed.notify_all();
+        }
+
+        std::lock_guard<std::mutex> objectGuard(objectLock);
+        delete renderer;
+        delete camera;
+    };
+
+    std::vector<std::thread> threads;
+    for(unsigned int w = 0; w < this->numWorkers; w++)
+        threads.push_back(std::thread(loadTimesteps));
+    for(unsigned int r = 0; r < this->numRenderers; r++)
+        threads.push_back(std::thread(renderTimesteps));
+    for(int i = 0; i < threads.size(); i++)
+        threads[i].join();
+    delete transferFunction;
+
+    this->totalTime = secondsSince(start);
+}
+
+bool ThumbnailRenderer::saveMontage(std::string filename, unsigned int columns)
+{
+    IMAGETYPE imageType = Renderer::getFiletype(filename);
+    if(imageType == INVALID) {
+        std::cerr << "Invalid image filetype requested!" << std::endl;
+        return false;
+    }
+    if(this->images.empty())
+        return false;
+
+    unsigned int count = this->images.size();
+    if(columns == 0)
+        columns = (unsigned int)std::ceil(std::sqrt((float)count));
+    columns = std::min(columns, count);
+    unsigned int rows = (count + columns - 1) / columns;
+    int width = columns * this->imageWidth;
+    int height = rows * this->imageHeight;
+
+    // failed thumbnails leave a gap of background
+    std::vector<unsigned char> background = this->config->bgColor;
+    background.resize(3, 0);
+    std::vector<unsigned char> montage(4L * width * height);
+    for(long int p = 0; p < (long int)width * height; p++) {
+        montage[4*p + 0] = background[0];
+        montage[4*p + 1] = background[1];
+        montage[4*p + 2] = background[2];
+        montage[4*p + 3] = 255;
+    }
+
+    int rowBytes = 4 * this->imageWidth;
+    for(unsigned int t = 0; t < count; t++) {
+        const std::vector<unsigned char> &image = this->images[t];
+        if(image.size() != rowBytes * this->imageHeight)
+            continue;
+        int x = (t % columns) * this->imageWidth;
+        int y = (t / columns) * this->imageHeight;
+        for(int j = 0; j < this->imageHeight; j++)
+            std::copy(image.begin() + j * rowBytes,
+                    image.begin() + (j + 1) * rowBytes,
+                    montage.begin() + 4L * ((long int)(y + j) * width + x));
+    }
+
+    Renderer::writeImage(filename, imageType, montage, width, height);
+    return true;
+}
+
+void ThumbnailRenderer::printTimings()
+{
+    // load and render are summed over the threads doing them
+    unsigned int failed = 0;
+    for(int t = 0; t < this->images.size(); t++)
+        if(this->images[t].empty())
+            failed++;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << this->images.size() << " thumbnails (" << failed;
+    std::cout << " failed) in " << this->totalTime << " s, load ";
+    std::cout << this->loadTime << " s, render " << this->renderTime;
+    std::cout << " s" << std::endl;
+}
+
+}
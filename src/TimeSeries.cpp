@@ -1,4 +1,7 @@
+#include "DataFile.h"
+#include "RangeIndex.h"
 #include "TimeSeries.h"
+#include "TransferFunction.h"
 #include "Volume.h"
 
 #include <iostream>
@@ -15,10 +18,30 @@ TimeSeries::TimeSeries(std::vector<std::string> filenames,
     this->volumes = new Volume*[this->length];
     for(int i = 0; i < this->length; i++)
         this->volumes[i] = NULL;
+    this->pins.resize(this->length, 0);
+    this->compressedData.resize(this->length, NULL);
+    this->residentStatistics = CacheTierStatistics();
+    this->compressedStatistics = CacheTierStatistics();
     this->initSystemInfo();
     // default values for volume attributes
     this->opacityAttenuation = 1.0;
     this->doMemoryMap = false;
+    this->doPrefault = false;
+    this->doApproximateStats = false;
+    this->lowPercentile = 0.0;
+    this->highPercentile = 100.0;
+    this->downsample = 1;
+    this->decimation = DECIMATE_AVERAGE;
+    this->quantizeBits = 0;
+    this->sharedStore = NULL;
+    this->quantizationError = 0.0;
+    this->fullVolume = NULL;
+    this->fullVolumeIndex = 0;
+    this->interpolatedVolume = NULL;
+    this->interpolatedTime = 0.0;
+    // created on first use, after OSPRay has been initialized
+    this->transferFunction = NULL;
+    this->rangeIndex = NULL;
 }
 
 TimeSeries::TimeSeries(std::vector<std::string> filenames,
@@ -29,7 +52,30 @@ TimeSeries::TimeSeries(std::vector<std::string> filenames,
     this->volumes = new Volume*[this->length];
     for(int i = 0; i < this->length; i++)
         this->volumes[i] = NULL;
+    this->pins.resize(this->length, 0);
+    this->compressedData.resize(this->length, NULL);
+    this->residentStatistics = CacheTierStatistics();
+    this->compressedStatistics = CacheTierStatistics();
     this->initSystemInfo();
+    // default values for volume attributes
+    this->opacityAttenuation = 1.0;
+    this->doMemoryMap = false;
+    this->doPrefault = false;
+    this->doApproximateStats = false;
+    this->lowPercentile = 0.0;
+    this->highPercentile = 100.0;
+    this->downsample = 1;
+    this->decimation = DECIMATE_AVERAGE;
+    this->quantizeBits = 0;
+    this->sharedStore = NULL;
+    this->quantizationError = 0.0;
+    this->fullVolume = NULL;
+    this->fullVolumeIndex = 0;
+    this->interpolatedVolume = NULL;
+    this->interpolatedTime = 0.0;
+    // created on first use, after OSPRay has been initialized
+    this->transferFunction = NULL;
+    this->rangeIndex = NULL;
 }
 
 TimeSeries::~TimeSeries()
@@ -40,6 +86,12 @@ TimeSeries::~TimeSeries()
             this->volumes[i] = NULL;
         }
     }
+    delete[] this->volumes;
+    this->clearCompressed();
+    delete this->fullVolume;
+    delete this->interpolatedVolume;
+    delete this->transferFunction;
+    delete this->rangeIndex;
 }
 
 void TimeSeries::initSystemInfo()
@@ -54,7 +106,23 @@ void TimeSeries::initSystemInfo()
         1073741824L; // GB
     maxUsage = this->systemInfo.mem_unit * this->systemInfo.freeram *
         0.5; // bytes
-    this->maxVolumes = maxUsage / this->dataSize;
+    this->maxBytes = maxUsage;
+    this->residentStatistics.maxBytes = maxUsage;
+    this->updateMaxVolumes();
+}
+
+void TimeSeries::updateMaxVolumes()
+{
+    // downsampled volumes take up the file's size over factor^3, and
+    // quantized ones a quarter or half of that
+    unsigned long f = this->downsample;
+    unsigned long valueBytes = sizeof(float);
+    if(this->quantizeBits != 0)
+        valueBytes = this->quantizeBits / 8;
+    unsigned long volumeBytes = ((this->xDim + f - 1) / f) *
+        ((this->yDim + f - 1) / f) * ((this->zDim + f - 1) / f) *
+        valueBytes;
+    this->maxVolumes = this->maxBytes / volumeBytes;
 }
 
 void TimeSeries::setMaxMemory(unsigned int gigabytes)
@@ -71,63 +139,383 @@ void TimeSeries::setMaxMemory(unsigned int gigabytes)
         std::cerr << "requires. Keeping limit at previous value" << std::endl;
         return;
     }
-    this->maxVolumes = bytes / this->dataSize;
+    this->maxBytes = bytes;
+    this->residentStatistics.maxBytes = bytes;
+    this->updateMaxVolumes();
+}
+
+void TimeSeries::setCompressedMemory(unsigned int gigabytes)
+{
+    this->compressedStatistics.maxBytes = 1073741824L * gigabytes;
+    this->trimCompressed();
+}
+
+void TimeSeries::trimCompressed()
+{
+    // drop the least recently used until the rest fit
+    while(!this->compressedCache.empty() &&
+            this->compressedStatistics.bytes >
+            this->compressedStatistics.maxBytes) {
+        unsigned int oldest = this->compressedCache.front();
+        this->compressedCache.pop_front();
+        this->compressedStatistics.bytes -=
+            this->compressedData[oldest]->getResidentBytes();
+        this->compressedStatistics.volumes--;
+        delete this->compressedData[oldest];
+        this->compressedData[oldest] = NULL;
+    }
+}
+
+void TimeSeries::clearCompressed()
+{
+    for(int i = 0; i < this->compressedData.size(); i++) {
+        delete this->compressedData[i];
+        this->compressedData[i] = NULL;
+    }
+    this->compressedCache.clear();
+    this->compressedStatistics.bytes = 0;
+    this->compressedStatistics.volumes = 0;
+}
+
+static unsigned long int getVolumeBytes(Volume *volume)
+{
+    std::vector<int> bounds = volume->getBounds();
+    unsigned long int valueBytes = sizeof(float);
+    if(volume->getQuantizedBits() != 0)
+        valueBytes = volume->getQuantizedBits() / 8;
+    return (unsigned long int)bounds[0] * bounds[1] * bounds[2] *
+        valueBytes;
 }
 
 void TimeSeries::encache(unsigned int index)
 {
-    if(this->lruCache.size() >= this->maxVolumes) {
-        // check if the LRU is this index
-        if(this->lruCache.front() == index) {
-            this->lruCache.remove(index);
-            // and put it at the end
-            this->lruCache.push_back(index);
+    // remove this index if it was already here
+    this->lruCache.remove(index);
+
+    // make room by deleting the least recently used volumes, skipping any
+    // that are pinned
+    auto lru = this->lruCache.begin();
+    while(this->lruCache.size() >= this->maxVolumes &&
+            lru != this->lruCache.end()) {
+        if(this->pins[*lru] > 0) {
+            lru++;
+            continue;
+        }
+        this->evict(*lru);
+        lru = this->lruCache.erase(lru);
+    }
+
+    // and put it at the end
+    this->lruCache.push_back(index);
+}
+
+void TimeSeries::evict(unsigned int index)
+{
+    Volume *volume = this->volumes[index];
+    this->volumes[index] = NULL;
+    this->residentStatistics.bytes -= getVolumeBytes(volume);
+    this->residentStatistics.volumes--;
+    if(this->compressedStatistics.maxBytes == 0) {
+        delete volume;
+        return;
+    }
+
+    // keep the data, the OSPRay objects are cheap to make again
+    DataFile *dataFile = volume->releaseDataFile();
+    delete volume;
+    // shared data stays in the store, loading it again maps it back in
+    // rather than keeping a private copy
+    if(dataFile->isShared()) {
+        delete dataFile;
+        return;
+    }
+    dataFile->compress();
+    unsigned long int bytes = dataFile->getResidentBytes();
+    if(bytes > this->compressedStatistics.maxBytes) {
+        delete dataFile;
+        return;
+    }
+    this->compressedData[index] = dataFile;
+    this->compressedCache.push_back(index);
+    this->compressedStatistics.bytes += bytes;
+    this->compressedStatistics.volumes++;
+    this->trimCompressed();
+}
+
+void TimeSeries::pin(unsigned int index)
+{
+    if(index < this->length)
+        this->pins[index]++;
+}
+
+void TimeSeries::unpin(unsigned int index)
+{
+    if(index < this->length && this->pins[index] > 0)
+        this->pins[index]--;
+}
+
+Volume *TimeSeries::getVolume(unsigned int index)
+{
+    if(index >= this->length) {
+        std::cerr << "WARNING: Asked for volume " << index;
+        std::cerr << " in a time series of length " << length << std::endl;
+        return NULL;
+    }
+
+    if(this->volumes[index] == NULL) {
+        this->residentStatistics.misses++;
+        if(this->compressedData[index] != NULL) {
+            this->compressedStatistics.hits++;
+            this->volumes[index] = this->restoreVolume(index);
         }
         else {
-            // delete the LRU volume
-            delete this->volumes[this->lruCache.front()];
-            this->volumes[this->lruCache.front()] = NULL;
-            this->lruCache.pop_front();
+            if(this->compressedStatistics.maxBytes > 0)
+                this->compressedStatistics.misses++;
+            this->volumes[index] = this->loadVolume(index, this->downsample);
         }
+        if(this->volumes[index] == NULL)
+            return NULL;
+        this->residentStatistics.bytes +=
+            getVolumeBytes(this->volumes[index]);
+        this->residentStatistics.volumes++;
+        // place this volume in cache
+        this->encache(index);
     }
     else {
-        // remove this index if it was already here
+        this->residentStatistics.hits++;
+        // set it as the newest
         this->lruCache.remove(index);
-        // and put it at the end
         this->lruCache.push_back(index);
     }
+
+    return this->volumes[index];
 }
 
-Volume *TimeSeries::getVolume(unsigned int index)
+Volume *TimeSeries::getFullResolutionVolume(unsigned int index)
 {
+    if(this->downsample == 1)
+        return this->getVolume(index);
     if(index >= this->length) {
         std::cerr << "WARNING: Asked for volume " << index;
         std::cerr << " in a time series of length " << length << std::endl;
         return NULL;
     }
 
-    if(this->volumes[index] == NULL) {
-        // load the volume
-        if(this->dataVariable.empty())
-            this->volumes[index] = new Volume(this->dataFilenames[index],
-                    this->xDim, this->yDim, this->zDim, this->doMemoryMap);
-        else
-            this->volumes[index] = new Volume(this->dataFilenames[index],
-                    this->dataVariable, this->xDim, this->yDim, this->zDim,
-                    this->doMemoryMap);
-
-        // set any given attributes
-        if(!this->colorMap.empty())
-            this->volumes[index]->setColorMap(this->colorMap);
-        if(!this->opacityMap.empty())
-            this->volumes[index]->setOpacityMap(this->opacityMap);
-        this->volumes[index]->attenuateOpacity(this->opacityAttenuation);
-
-        // place this volume in cache and/or set it as the newest
-        this->encache(index);
+    if(this->fullVolume == NULL || this->fullVolumeIndex != index) {
+        delete this->fullVolume;
+        this->fullVolume = this->loadVolume(index, 1);
+        this->fullVolumeIndex = index;
     }
-    
-    return this->volumes[index];
+    return this->fullVolume;
+}
+
+Volume *TimeSeries::getInterpolatedVolume(float time)
+{
+    if(this->length == 0)
+        return NULL;
+    time = std::max(0.0f, std::min((float)(this->length - 1), time));
+    if(this->isInterpolated(time))
+        return this->interpolatedVolume;
+    unsigned int before = (unsigned int)time;
+    unsigned int after = std::min(before + 1, this->length - 1);
+    float weight = time - before;
+
+    // loading one neighbour mustn't evict the other
+    this->pin(before);
+    this->pin(after);
+    Volume *a = this->getVolume(before);
+    Volume *b = this->getVolume(after);
+    if(a == NULL || b == NULL) {
+        this->unpin(before);
+        this->unpin(after);
+        return NULL;
+    }
+    if(this->interpolatedVolume != NULL &&
+            this->interpolatedVolume->getBounds() != a->getBounds()) {
+        delete this->interpolatedVolume;
+        this->interpolatedVolume = NULL;
+    }
+    // the first blend starts out as a copy of a, so a failed blend is
+    // caught the same way whether or not the volume is new
+    if(this->interpolatedVolume == NULL)
+        this->interpolatedVolume = Volume::createInterpolated(a, a, 0.0,
+                this->getTransferFunction());
+    bool blended = this->interpolatedVolume != NULL &&
+        this->interpolatedVolume->interpolate(a, b, weight);
+    this->unpin(before);
+    this->unpin(after);
+    // a failed blend leaves the values, and the time they are for, alone
+    if(!blended)
+        return NULL;
+    this->interpolatedTime = time;
+    return this->interpolatedVolume;
+}
+
+Volume *TimeSeries::loadVolume(unsigned int index, unsigned int factor)
+{
+    // color and opacity are already set on the shared transfer
+    // function, so a new volume needs no transfer function work
+    // beyond possibly widening its range
+    // downsampled data has no use for memory mapping
+    TransferFunction *tf = this->getTransferFunction();
+    bool memmap = this->doMemoryMap && factor == 1;
+    Volume *volume;
+    if(this->quantizeBits != 0) {
+        // the floats are only around long enough for the statistics
+        // and the quantized copy would be private anyway, so quantized
+        // series don't go through the shared store
+        DataFile *dataFile = new DataFile(this->xDim, this->yDim,
+                this->zDim);
+        dataFile->loadFromFile(this->dataFilenames[index],
+                this->dataVariable, false, false, factor, this->decimation);
+        if(dataFile->data == NULL) {
+            std::cerr << "WARNING: could not load ";
+            std::cerr << this->dataFilenames[index] << std::endl;
+            delete dataFile;
+            return NULL;
+        }
+        dataFile->calculateStatistics();
+        dataFile->quantize(this->quantizeBits);
+        this->quantizationError = std::max(this->quantizationError,
+                dataFile->quantizeError);
+        volume = new Volume(dataFile, tf);
+    }
+    else if(this->dataVariable.empty())
+        volume = new Volume(this->dataFilenames[index], this->xDim,
+                this->yDim, this->zDim, memmap, this->doPrefault,
+                this->doApproximateStats, tf, factor, this->decimation,
+                this->sharedStore);
+    else
+        volume = new Volume(this->dataFilenames[index], this->dataVariable,
+                this->xDim, this->yDim, this->zDim, memmap,
+                this->doPrefault, this->doApproximateStats, tf, factor,
+                this->decimation, this->sharedStore);
+
+    if(this->lowPercentile > 0.0 || this->highPercentile < 100.0)
+        volume->setRangePercentiles(this->lowPercentile,
+                this->highPercentile);
+    this->expandRange(volume);
+
+    // estimated statistics come without macrocells, the background
+    // scan picks those timesteps up instead, and downsampled ones have
+    // the wrong bricks
+    if(this->rangeIndex != NULL && !this->doApproximateStats &&
+            factor == 1 && !this->rangeIndex->isIndexed(index))
+        this->rangeIndex->add(index, volume->getMacrocells());
+    return volume;
+}
+
+Volume *TimeSeries::restoreVolume(unsigned int index)
+{
+    DataFile *dataFile = this->compressedData[index];
+    this->compressedData[index] = NULL;
+    this->compressedCache.remove(index);
+    this->compressedStatistics.bytes -= dataFile->getResidentBytes();
+    this->compressedStatistics.volumes--;
+
+    // decompressing is parallel and skips the disk, the statistics and
+    // macrocells were kept with the data
+    if(!dataFile->decompress()) {
+        delete dataFile;
+        return this->loadVolume(index, this->downsample);
+    }
+    Volume *volume = new Volume(dataFile, this->getTransferFunction());
+    if(this->lowPercentile > 0.0 || this->highPercentile < 100.0)
+        volume->setRangePercentiles(this->lowPercentile,
+                this->highPercentile);
+    this->expandRange(volume);
+    return volume;
+}
+
+void TimeSeries::printCacheStatistics()
+{
+    CacheTierStatistics *tiers[2] = {&this->residentStatistics,
+        &this->compressedStatistics};
+    const char *names[2] = {"resident", "compressed"};
+    for(int t = 0; t < 2; t++) {
+        std::cout << names[t] << ": " << tiers[t]->volumes << " volumes, ";
+        std::cout << tiers[t]->bytes << " of " << tiers[t]->maxBytes;
+        std::cout << " bytes, " << tiers[t]->hits << " hits, ";
+        std::cout << tiers[t]->misses << " misses" << std::endl;
+    }
+}
+
+CacheTierStatistics TimeSeries::getResidentStatistics()
+{
+    return this->residentStatistics;
+}
+
+CacheTierStatistics TimeSeries::getCompressedStatistics()
+{
+    return this->compressedStatistics;
+}
+
+bool TimeSeries::isLoaded(unsigned int index)
+{
+    return index < this->length && this->volumes[index] != NULL;
+}
+
+bool TimeSeries::isInterpolated(float time)
+{
+    time = std::max(0.0f, std::min((float)(this->length - 1), time));
+    return this->interpolatedVolume != NULL &&
+        this->interpolatedTime == time;
+}
+
+bool TimeSeries::isFullResolutionLoaded(unsigned int index)
+{
+    if(this->downsample == 1)
+        return this->isLoaded(index);
+    return this->fullVolume != NULL && this->fullVolumeIndex == index;
+}
+
+TransferFunction *TimeSeries::getTransferFunction()
+{
+    if(this->transferFunction == NULL)
+        this->transferFunction = new TransferFunction();
+    return this->transferFunction;
+}
+
+RangeIndex *TimeSeries::getRangeIndex()
+{
+    if(this->rangeIndex == NULL)
+        this->rangeIndex = new RangeIndex(this->dataFilenames, this->xDim,
+                this->yDim, this->zDim, this->dataVariable);
+    return this->rangeIndex;
+}
+
+void TimeSeries::indexRanges(std::string indexFilename)
+{
+    RangeIndex *index = this->getRangeIndex();
+    if(!indexFilename.empty())
+        index->load(indexFilename);
+    float minimum, maximum;
+    TransferFunction *tf = this->getTransferFunction();
+    if(!tf->isRangeFixed() && index->getValueRange(minimum, maximum))
+        tf->fixRange(minimum, maximum);
+    index->build(indexFilename);
+}
+
+void TimeSeries::setValueRange(float minimum, float maximum)
+{
+    this->getTransferFunction()->fixRange(minimum, maximum);
+}
+
+void TimeSeries::expandRange(Volume *volume)
+{
+    // keep one range across the series so colors mean the same thing in
+    // every timestep
+    // by default it grows with the timesteps loaded so far, and with
+    // their exact statistics as those arrive, until every timestep is
+    // indexed, after which it's fixed to the whole series' range so it
+    // no longer depends on which timesteps happened to be loaded
+    TransferFunction *tf = this->getTransferFunction();
+    float minimum, maximum;
+    if(!tf->isRangeFixed() && this->rangeIndex != NULL &&
+            this->rangeIndex->getValueRange(minimum, maximum))
+        tf->fixRange(minimum, maximum);
+    std::vector<float> range = volume->getValueRange();
+    tf->includeRange(range[0], range[1]);
 }
 
 int TimeSeries::getVolumeIndex(std::string filename)
@@ -167,6 +555,8 @@ void TimeSeries::setColorMap(std::vector<float> &map)
     if(map.empty())
         return;
     this->colorMap = map;
+    // resident volumes see this through the shared transfer function
+    this->getTransferFunction()->setColorMap(map);
 }
 
 void TimeSeries::setOpacityMap(std::vector<float> &map)
@@ -174,11 +564,13 @@ void TimeSeries::setOpacityMap(std::vector<float> &map)
     if(map.empty())
         return;
     this->opacityMap = map;
+    this->getTransferFunction()->setOpacityMap(map);
 }
 
 void TimeSeries::setOpacityAttenuation(float attenuation)
 {
     this->opacityAttenuation = attenuation;
+    this->getTransferFunction()->attenuateOpacity(attenuation);
 }
 
 void TimeSeries::setMemoryMapping(bool toMMap)
@@ -186,4 +578,75 @@ void TimeSeries::setMemoryMapping(bool toMMap)
     this->doMemoryMap = toMMap;
 }
 
+void TimeSeries::setMemoryPrefault(bool toPrefault)
+{
+    // only has an effect when memory mapping is enabled
+    this->doPrefault = toPrefault;
+}
+
+void TimeSeries::setApproximateStatistics(bool toApproximate)
+{
+    this->doApproximateStats = toApproximate;
+}
+
+void TimeSeries::setRangePercentiles(float low, float high)
+{
+    this->lowPercentile = low;
+    this->highPercentile = high;
+
+    // the shared range starts over from the resident timesteps, since
+    // including their new ranges would only ever widen it
+    float minimum, maximum;
+    bool resident = false;
+    for(unsigned int i = 0; i < this->length; i++) {
+        Volume *volume = this->volumes[i];
+        if(volume == NULL)
+            continue;
+        volume->setRangePercentiles(low, high);
+        std::vector<float> range = volume->getValueRange();
+        minimum = resident ? std::min(minimum, range[0]) : range[0];
+        maximum = resident ? std::max(maximum, range[1]) : range[1];
+        resident = true;
+    }
+
+    TransferFunction *tf = this->getTransferFunction();
+    if(tf->isRangeFixed())
+        return;
+    if(this->rangeIndex != NULL &&
+            this->rangeIndex->getValueRange(minimum, maximum))
+        tf->fixRange(minimum, maximum);
+    else if(resident)
+        tf->setRange(minimum, maximum);
+}
+
+void TimeSeries::setQuantization(unsigned int bits)
+{
+    if(bits != 0 && bits != 8 && bits != 16) {
+        std::cerr << "WARNING: can only quantize to 8 or 16 bits, not ";
+        std::cerr << bits << std::endl;
+        return;
+    }
+    this->quantizeBits = bits;
+    this->clearCompressed();
+    this->updateMaxVolumes();
+}
+
+float TimeSeries::getQuantizationError()
+{
+    return this->quantizationError;
+}
+
+void TimeSeries::setSharedStore(SharedVolumeStore *store)
+{
+    this->sharedStore = store;
+}
+
+void TimeSeries::setDownsample(unsigned int factor, DECIMATION decimation)
+{
+    this->downsample = std::max(factor, 1u);
+    this->decimation = decimation;
+    this->clearCompressed();
+    this->updateMaxVolumes();
+}
+
 }
@@ -1,14 +1,17 @@
 #include "TransferFunction.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 namespace pbnj {
 
-TransferFunction::TransferFunction()
+TransferFunction::TransferFunction() :
+    attenuation(1.0), minVal(0.0), maxVal(1.0), rangeIncluded(false),
+    rangeFixed(false), dirty(false), opacityVersion(0)
 {
     this->colorMap.reserve(256*3);
-    this->opacityMap.reserve(256);
+    this->baseOpacityMap.reserve(256);
 
     //default black to white color map
     //and ramp opacity map
@@ -16,22 +19,29 @@ TransferFunction::TransferFunction()
         this->colorMap.push_back(i/255.0);
         this->colorMap.push_back(i/255.0);
         this->colorMap.push_back(i/255.0);
-        this->opacityMap.push_back(i/255.0);
+        this->baseOpacityMap.push_back(i/255.0);
     }
+    this->opacityMap = this->baseOpacityMap;
 
     // setup OSPRay object(s)
+    // the data arrays point straight at our vectors so that changes of the
+    // same length only need the transfer function to be recommitted
     this->oTF = ospNewTransferFunction("piecewise_linear");
     this->oColorData = ospNewData(this->colorMap.size()/3, OSP_FLOAT3,
-            this->colorMap.data());
+            this->colorMap.data(), OSP_DATA_SHARED_BUFFER);
     this->oOpacityData = ospNewData(this->opacityMap.size(), OSP_FLOAT,
-            this->opacityMap.data());
+            this->opacityMap.data(), OSP_DATA_SHARED_BUFFER);
     ospSetData(this->oTF, "colors", this->oColorData);
     ospSetData(this->oTF, "opacities", this->oOpacityData);
+    float range[] = {this->minVal, this->maxVal};
+    ospSet2fv(this->oTF, "valueRange", range);
     ospCommit(this->oTF);
 }
 
 TransferFunction::~TransferFunction()
 {
+    for(int c = 0; c < this->scaledCopies.size(); c++)
+        ospRelease(this->scaledCopies[c].oTF);
     ospRelease(this->oTF);
     ospRelease(this->oColorData);
     ospRelease(this->oOpacityData);
@@ -49,20 +59,66 @@ void TransferFunction::setRange(float minimum, float maximum)
 
     float temp[] = {this->minVal, this->maxVal};
     ospSet2fv(this->oTF, "valueRange", temp);
-    ospCommit(this->oTF);
+    this->dirty = true;
+    this->opacityVersion++;
+}
+
+std::vector<float> TransferFunction::getRange()
+{
+    std::vector<float> range = {this->minVal, this->maxVal};
+    return range;
+}
+
+void TransferFunction::includeRange(float minimum, float maximum)
+{
+    if(this->rangeFixed)
+        return;
+    // only changes are committed
+    if(this->rangeIncluded) {
+        if(minimum >= this->minVal && maximum <= this->maxVal)
+            return;
+        minimum = std::min(minimum, this->minVal);
+        maximum = std::max(maximum, this->maxVal);
+    }
+    this->setRange(minimum, maximum);
+    this->rangeIncluded = true;
+}
+
+void TransferFunction::fixRange(float minimum, float maximum)
+{
+    this->setRange(minimum, maximum);
+    this->rangeIncluded = true;
+    this->rangeFixed = true;
+}
+
+void TransferFunction::unfixRange()
+{
+    this->rangeFixed = false;
+}
+
+bool TransferFunction::isRangeFixed()
+{
+    return this->rangeFixed;
 }
 
 void TransferFunction::attenuateOpacity(float amount)
 {
-    if(amount >= 1.0)
+    // attenuation >= 1.0 doesn't do anything
+    amount = std::min(amount, 1.0f);
+    if(amount == this->attenuation)
         return;
-    for(int i = 0; i < this->opacityMap.size(); i++)
-        this->opacityMap[i] = this->opacityMap[i] * amount;
+    this->attenuation = amount;
+    this->updateOpacity();
+}
 
-    this->oOpacityData = ospNewData(this->opacityMap.size(), OSP_FLOAT,
-            this->opacityMap.data());
-    ospSetData(this->oTF, "opacities", this->oOpacityData);
+void TransferFunction::commit()
+{
+    if(!this->dirty)
+        return;
     ospCommit(this->oTF);
+    for(int c = 0; c < this->scaledCopies.size(); c++)
+        this->updateScaledCopy(this->scaledCopies[c]);
+    this->dirty = false;
 }
 
 OSPTransferFunction TransferFunction::asOSPObject()
@@ -70,26 +126,59 @@ OSPTransferFunction TransferFunction::asOSPObject()
     return this->oTF;
 }
 
+OSPTransferFunction TransferFunction::createScaledOSPObject(float offset,
+        float scale)
+{
+    ScaledCopy copy;
+    copy.offset = offset;
+    copy.scale = scale == 0.0 ? 1.0 : scale;
+    copy.oTF = ospNewTransferFunction("piecewise_linear");
+    this->updateScaledCopy(copy);
+    this->scaledCopies.push_back(copy);
+    return copy.oTF;
+}
+
+void TransferFunction::releaseScaledOSPObject(OSPTransferFunction scaled)
+{
+    for(int c = 0; c < this->scaledCopies.size(); c++) {
+        if(this->scaledCopies[c].oTF == scaled) {
+            ospRelease(scaled);
+            this->scaledCopies.erase(this->scaledCopies.begin() + c);
+            return;
+        }
+    }
+}
+
+void TransferFunction::updateScaledCopy(ScaledCopy &copy)
+{
+    // the copies share the color and opacity arrays, only the range moves
+    float range[] = {(this->minVal - copy.offset) / copy.scale,
+        (this->maxVal - copy.offset) / copy.scale};
+    ospSetData(copy.oTF, "colors", this->oColorData);
+    ospSetData(copy.oTF, "opacities", this->oOpacityData);
+    ospSet2fv(copy.oTF, "valueRange", range);
+    ospCommit(copy.oTF);
+}
+
 void TransferFunction::setColorMap(std::vector<float> &map)
 {
     //map may be empty if the config file is used
     if(map.empty())
         return;
 
-    //clear in case the new map is shorter than the previous, in which case
-    //reserve won't do anything
-    //reserve in case the new map is longer than the previous
-    this->colorMap.clear();
-    this->colorMap.reserve(map.size());
-
-    for(int i = 0; i < map.size(); i++)
-        this->colorMap.push_back(map[i]);
-
-    this->oColorData = ospNewData(this->colorMap.size() / 3, OSP_FLOAT3,
-            this->colorMap.data());
-    ospSetData(this->oTF, "colors", this->oColorData);
-
-    ospCommit(this->oTF);
+    if(map.size() == this->colorMap.size()) {
+        //same length, overwrite the shared buffer in place
+        std::copy(map.begin(), map.end(), this->colorMap.begin());
+    }
+    else {
+        //the buffer may move, so OSPRay needs a new data array
+        this->colorMap = map;
+        ospRelease(this->oColorData);
+        this->oColorData = ospNewData(this->colorMap.size() / 3, OSP_FLOAT3,
+                this->colorMap.data(), OSP_DATA_SHARED_BUFFER);
+        ospSetData(this->oTF, "colors", this->oColorData);
+    }
+    this->dirty = true;
 }
 
 void TransferFunction::setOpacityMap(std::vector<float> &map)
@@ -98,18 +187,63 @@ void TransferFunction::setOpacityMap(std::vector<float> &map)
     if(map.empty())
         return;
 
-    //clear in case the new map is shorter than the previous
-    //reserver in case the new map is longer than the previous
-    this->opacityMap.clear();
-    this->opacityMap.reserve(map.size());
+    this->baseOpacityMap = map;
+    this->updateOpacity();
+}
 
-    for(int i = 0; i < map.size(); i++)
-        this->opacityMap.push_back(map[i]);
+float TransferFunction::getMaxOpacity(float low, float high)
+{
+    // the map is spread evenly over the range and interpolated linearly,
+    // values outside the range take the end opacities
+    int last = this->opacityMap.size() - 1;
+    if(last < 0 || low > high)
+        return 0.0;
+    float scale = 0.0;
+    if(this->maxVal > this->minVal)
+        scale = last / (this->maxVal - this->minVal);
+    float from = std::max(0.0f, std::min((float)last,
+                (low - this->minVal) * scale));
+    float to = std::max(0.0f, std::min((float)last,
+                (high - this->minVal) * scale));
+
+    auto opacityAt = [&](float position) {
+        int i = std::min((int)position, std::max(last - 1, 0));
+        float t = position - i;
+        if(last == 0)
+            return this->opacityMap[0];
+        return this->opacityMap[i] + t*(this->opacityMap[i + 1] -
+                this->opacityMap[i]);
+    };
+    float maximum = std::max(opacityAt(from), opacityAt(to));
+    for(int i = (int)from + 1; i <= to; i++)
+        maximum = std::max(maximum, this->opacityMap[i]);
+    return maximum;
+}
 
-    this->oOpacityData = ospNewData(this->opacityMap.size(), OSP_FLOAT,
-            this->opacityMap.data());
-    ospSetData(this->oTF, "opacities", this->oOpacityData);
-    ospCommit(this->oTF);
+unsigned long int TransferFunction::getOpacityVersion()
+{
+    return this->opacityVersion;
+}
+
+void TransferFunction::updateOpacity()
+{
+    //resizing may move the buffer, so OSPRay needs a new data array then
+    bool resized = this->baseOpacityMap.size() != this->opacityMap.size();
+    if(resized)
+        this->opacityMap.resize(this->baseOpacityMap.size());
+
+    //apply the attenuation on top of the base map
+    for(int i = 0; i < this->baseOpacityMap.size(); i++)
+        this->opacityMap[i] = this->baseOpacityMap[i] * this->attenuation;
+
+    if(resized) {
+        ospRelease(this->oOpacityData);
+        this->oOpacityData = ospNewData(this->opacityMap.size(), OSP_FLOAT,
+                this->opacityMap.data(), OSP_DATA_SHARED_BUFFER);
+        ospSetData(this->oTF, "opacities", this->oOpacityData);
+    }
+    this->dirty = true;
+    this->opacityVersion++;
 }
 
 }
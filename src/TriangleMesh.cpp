@@ -0,0 +1,366 @@
+#include "DataFile.h"
+#include "MacrocellGrid.h"
+#include "TriangleMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdio.h>
+
+namespace pbnj {
+
+namespace {
+
+/*
+ * Marching cubes cases, generated rather than typed in. Corner c of a cell
+ * sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1). For each of the 256 inside/
+ * outside patterns the surface crosses the cube faces in segments, which
+ * chain into loops around the inside corners and are triangulated as fans.
+ * A face with two diagonal inside corners always keeps them apart, and
+ * since neighbouring cells see the same face the mesh has no cracks.
+ */
+struct CubeCases {
+    int edgeCorners[12][2];
+    int edgeAxis[12];
+    // three edges per triangle
+    std::vector<int> triangles[256];
+
+    bool shareFace(int a, int b)
+    {
+        int corners[4] = {this->edgeCorners[a][0], this->edgeCorners[a][1],
+            this->edgeCorners[b][0], this->edgeCorners[b][1]};
+        for(int axis = 0; axis < 3; axis++) {
+            int bits = 0;
+            for(int c = 0; c < 4; c++)
+                bits += (corners[c] >> axis) & 1;
+            if(bits == 0 || bits == 4)
+                return true;
+        }
+        return false;
+    }
+
+    CubeCases()
+    {
+        int edgeOf[8][3];
+        int e = 0;
+        for(int c = 0; c < 8; c++) {
+            for(int axis = 0; axis < 3; axis++) {
+                if(c & (1 << axis))
+                    continue;
+                this->edgeCorners[e][0] = c;
+                this->edgeCorners[e][1] = c | (1 << axis);
+                this->edgeAxis[e] = axis;
+                edgeOf[c][axis] = e++;
+            }
+        }
+
+        // face corners counterclockwise as seen from outside the cube
+        int faces[6][4];
+        for(int axis = 0; axis < 3; axis++) {
+            int u = (axis + 1) % 3, w = (axis + 2) % 3;
+            for(int side = 0; side < 2; side++) {
+                int *face = faces[2*axis + side];
+                int base = side << axis;
+                face[0] = base;
+                face[1] = base | (1 << u);
+                face[2] = base | (1 << u) | (1 << w);
+                face[3] = base | (1 << w);
+                if(side == 0)
+                    std::swap(face[1], face[3]);
+            }
+        }
+
+        for(int mask = 1; mask < 255; mask++) {
+            // each crossed edge starts one segment, where the face walk
+            // enters the inside corners, and ends another
+            int next[12];
+            std::fill(next, next + 12, -1);
+            for(int f = 0; f < 6; f++) {
+                int crossings[4], entering[4], numCrossings = 0;
+                for(int k = 0; k < 4; k++) {
+                    int p = faces[f][k], q = faces[f][(k + 1) % 4];
+                    bool inP = (mask >> p) & 1, inQ = (mask >> q) & 1;
+                    if(inP == inQ)
+                        continue;
+                    int axis = 0;
+                    while(((p ^ q) >> axis) != 1)
+                        axis++;
+                    crossings[numCrossings] = edgeOf[p & q][axis];
+                    entering[numCrossings++] = inQ;
+                }
+                for(int i = 0; i < numCrossings; i++) {
+                    if(!entering[i])
+                        continue;
+                    int j = (i + 1) % numCrossings;
+                    while(entering[j])
+                        j = (j + 1) % numCrossings;
+                    next[crossings[i]] = crossings[j];
+                }
+            }
+
+            bool visited[12] = {false};
+            for(int start = 0; start < 12; start++) {
+                if(next[start] == -1 || visited[start])
+                    continue;
+                std::vector<int> loop;
+                for(int edge = start; !visited[edge]; edge = next[edge]) {
+                    visited[edge] = true;
+                    loop.push_back(edge);
+                }
+                // a fan diagonal lying in a cube face would be shared with
+                // the neighbouring cell, so start the fan where there are
+                // none if possible
+                int n = loop.size(), apex = 0;
+                for(int first = 0; first < n; first++) {
+                    bool inFace = false;
+                    for(int i = 2; i + 1 < n; i++)
+                        inFace = inFace || this->shareFace(loop[first],
+                                loop[(first + i) % n]);
+                    if(!inFace) {
+                        apex = first;
+                        break;
+                    }
+                }
+                for(int i = 1; i + 1 < n; i++) {
+                    this->triangles[mask].push_back(loop[apex]);
+                    this->triangles[mask].push_back(loop[(apex + i) % n]);
+                    this->triangles[mask].push_back(loop[(apex + i + 1) % n]);
+                }
+            }
+        }
+
+        // the walk direction fixes the winding for every case, so one
+        // case is enough to tell whether it has to be flipped to face
+        // away from the inside corners
+        float p[3][3];
+        for(int v = 0; v < 3; v++) {
+            int edge = this->triangles[1][v];
+            for(int axis = 0; axis < 3; axis++)
+                p[v][axis] = axis == this->edgeAxis[edge] ? 0.5 :
+                    ((this->edgeCorners[edge][0] >> axis) & 1);
+        }
+        float a[3], b[3];
+        for(int axis = 0; axis < 3; axis++) {
+            a[axis] = p[1][axis] - p[0][axis];
+            b[axis] = p[2][axis] - p[0][axis];
+        }
+        float outward = (a[1]*b[2] - a[2]*b[1]) + (a[2]*b[0] - a[0]*b[2]) +
+            (a[0]*b[1] - a[1]*b[0]);
+        if(outward < 0) {
+            for(int mask = 0; mask < 256; mask++)
+                for(int t = 0; t < this->triangles[mask].size(); t += 3)
+                    std::swap(this->triangles[mask][t + 1],
+                            this->triangles[mask][t + 2]);
+        }
+    }
+};
+
+const CubeCases &getCubeCases()
+{
+    static CubeCases cases;
+    return cases;
+}
+
+// what one thread extracted from its slab of bricks, vertices are keyed by
+// the grid edge they lie on so slabs can be welded together afterwards
+struct MeshPiece {
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<long int> edges;
+    std::vector<int> triangles;
+};
+
+}
+
+TriangleMesh::TriangleMesh(DataFile *df, float isovalue) :
+    isovalue(isovalue)
+{
+    this->extract(df);
+}
+
+long int TriangleMesh::getNumVertices()
+{
+    return this->vertices.size() / 3;
+}
+
+long int TriangleMesh::getNumTriangles()
+{
+    return this->triangles.size() / 3;
+}
+
+void TriangleMesh::extract(DataFile *df)
+{
+    const CubeCases &cases = getCubeCases();
+    long int nx = df->xDim, ny = df->yDim, nz = df->zDim;
+    if(nx < 2 || ny < 2 || nz < 2 || df->data == NULL)
+        return;
+    const float *data = df->data;
+    float iso = this->isovalue;
+
+    // cells are visited brick by brick, skipping the bricks the isovalue
+    // doesn't pass through
+    MacrocellGrid *grid = df->getMacrocells();
+    std::vector<MeshPiece> pieces(getNumThreads());
+
+    parallelFor(grid->zBricks, [&](unsigned int thread, long int begin,
+                long int end) {
+        MeshPiece &piece = pieces[thread];
+        std::unordered_map<long int, int> vertexOnEdge;
+
+        auto at = [&](long int x, long int y, long int z) {
+            return data[x + nx*(y + ny*z)];
+        };
+        auto gradient = [&](long int x, long int y, long int z, float *g) {
+            g[0] = at(std::min(x + 1, nx - 1), y, z) -
+                at(std::max(x - 1, 0L), y, z);
+            g[1] = at(x, std::min(y + 1, ny - 1), z) -
+                at(x, std::max(y - 1, 0L), z);
+            g[2] = at(x, y, std::min(z + 1, nz - 1)) -
+                at(x, y, std::max(z - 1, 0L));
+        };
+
+        for(long int bz = begin; bz < end; bz++)
+        for(long int by = 0; by < grid->yBricks; by++)
+        for(long int bx = 0; bx < grid->xBricks; bx++) {
+            long int brick = grid->getBrick(bx, by, bz);
+            if(!grid->crossesIsovalue(brick, iso))
+                continue;
+            // cells [lo, hi) touch voxels [lo, hi]
+            int lo[3], hi[3];
+            grid->getBrickVoxels(brick, lo, hi);
+
+            for(long int z = lo[2]; z < hi[2]; z++)
+            for(long int y = lo[1]; y < hi[1]; y++)
+            for(long int x = lo[0]; x < hi[0]; x++) {
+                long int index[8];
+                float value[8];
+                int mask = 0;
+                for(int c = 0; c < 8; c++) {
+                    index[c] = (x + (c & 1)) +
+                        nx*((y + ((c >> 1) & 1)) + ny*(z + ((c >> 2) & 1)));
+                    value[c] = data[index[c]];
+                    if(value[c] > iso)
+                        mask |= 1 << c;
+                }
+                const std::vector<int> &edges = cases.triangles[mask];
+                for(int e = 0; e < edges.size(); e++) {
+                    int p = cases.edgeCorners[edges[e]][0];
+                    int q = cases.edgeCorners[edges[e]][1];
+                    int axis = cases.edgeAxis[edges[e]];
+                    long int edgeID = 3*index[p] + axis;
+
+                    auto found = vertexOnEdge.find(edgeID);
+                    if(found != vertexOnEdge.end()) {
+                        piece.triangles.push_back(found->second);
+                        continue;
+                    }
+
+                    // interpolate the position and the gradient between
+                    // the voxels at either end of the edge
+                    float t = (iso - value[p]) / (value[q] - value[p]);
+                    long int px = x + (p & 1), py = y + ((p >> 1) & 1),
+                         pz = z + ((p >> 2) & 1);
+                    float position[3] = {(float)px, (float)py, (float)pz};
+                    position[axis] += t;
+                    float gp[3], gq[3], normal[3];
+                    gradient(px, py, pz, gp);
+                    gradient(px + (axis == 0), py + (axis == 1),
+                            pz + (axis == 2), gq);
+                    float length = 0;
+                    for(int i = 0; i < 3; i++) {
+                        normal[i] = -(gp[i] + t*(gq[i] - gp[i]));
+                        length += normal[i]*normal[i];
+                    }
+                    length = std::sqrt(length);
+                    for(int i = 0; i < 3; i++)
+                        normal[i] = length > 0 ? normal[i]/length :
+                            (i == 2);
+
+                    int vertex = piece.edges.size();
+                    vertexOnEdge[edgeID] = vertex;
+                    piece.edges.push_back(edgeID);
+                    piece.vertices.insert(piece.vertices.end(), position,
+                            position + 3);
+                    piece.normals.insert(piece.normals.end(), normal,
+                            normal + 3);
+                    piece.triangles.push_back(vertex);
+                }
+            }
+        }
+    });
+
+    // weld the slabs, only edges lying in a plane between two layers of
+    // bricks can show up in more than one of them
+    std::unordered_map<long int, int> shared;
+    for(int p = 0; p < pieces.size(); p++) {
+        MeshPiece &piece = pieces[p];
+        std::vector<int> remap(piece.edges.size());
+        for(int v = 0; v < piece.edges.size(); v++) {
+            long int edge = piece.edges[v];
+            long int z = (edge / 3) / (nx*ny);
+            bool onBoundary = edge % 3 != 2 && z % grid->brickSize == 0;
+            if(onBoundary) {
+                auto found = shared.find(edge);
+                if(found != shared.end()) {
+                    remap[v] = found->second;
+                    continue;
+                }
+            }
+            remap[v] = this->vertices.size() / 3;
+            if(onBoundary)
+                shared[edge] = remap[v];
+            this->vertices.insert(this->vertices.end(),
+                    &piece.vertices[3*v], &piece.vertices[3*v] + 3);
+            this->normals.insert(this->normals.end(),
+                    &piece.normals[3*v], &piece.normals[3*v] + 3);
+        }
+        for(int t = 0; t < piece.triangles.size(); t++)
+            this->triangles.push_back(remap[piece.triangles[t]]);
+        // done with it, give the memory back as we go
+        piece = MeshPiece();
+    }
+}
+
+bool TriangleMesh::save(std::string filename)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(file == NULL) {
+        std::cerr << "Could not open " << filename << std::endl;
+        return false;
+    }
+
+    fprintf(file, "ply\nformat binary_little_endian 1.0\n");
+    fprintf(file, "comment isovalue %g\n", this->isovalue);
+    fprintf(file, "element vertex %ld\n", this->getNumVertices());
+    fprintf(file, "property float x\nproperty float y\nproperty float z\n");
+    fprintf(file, "property float nx\nproperty float ny\nproperty float nz\n");
+    fprintf(file, "element face %ld\n", this->getNumTriangles());
+    fprintf(file, "property list uchar int vertex_indices\nend_header\n");
+
+    // x86 is little endian already, so records are written as they are
+    std::vector<float> vertex(6);
+    for(long int v = 0; v < this->getNumVertices(); v++) {
+        std::copy(&this->vertices[3*v], &this->vertices[3*v] + 3,
+                vertex.begin());
+        std::copy(&this->normals[3*v], &this->normals[3*v] + 3,
+                vertex.begin() + 3);
+        fwrite(vertex.data(), sizeof(float), 6, file);
+    }
+    unsigned char corners = 3;
+    for(long int t = 0; t < this->getNumTriangles(); t++) {
+        fwrite(&corners, 1, 1, file);
+        fwrite(&this->triangles[3*t], sizeof(int), 3, file);
+    }
+
+    bool written = !ferror(file);
+    fclose(file);
+    if(!written)
+        std::cerr << "Could not write " << filename << std::endl;
+    return written;
+}
+
+}
@@ -1,71 +1,186 @@
 #include "Volume.h"
 #include "DataFile.h"
+#include "MacrocellGrid.h"
 #include "TransferFunction.h"
+#include "TriangleMesh.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
 #include <vector>
 
 #include <ospray/ospray.h>
 
 namespace pbnj {
 
-Volume::Volume(std::string filename, int x, int y, int z, bool memmap)
+// meshes can be as large as the data, so only keep a few, a Renderer keeps
+// its own geometry for up to its maxIsosurfaces
+static const unsigned int MAX_MESHES = 4;
+
+Volume::Volume(std::string filename, int x, int y, int z, bool memmap,
+        bool prefault, bool approximate, TransferFunction *tf,
+        unsigned int downsample, DECIMATION decimation,
+        SharedVolumeStore *store) :
+    transferFunction(tf), ownsTransferFunction(false), version(0),
+    statsPending(false),
+    lowPercentile(0.0), highPercentile(100.0)
 {
     this->ID = createID();
     //volumes contain a datafile
     //one datafile per volume, one volume per renderer/camera
     this->dataFile = new DataFile(x, y, z);
-    this->loadFromFile(filename, "", memmap);
+    this->loadFromFile(filename, "", memmap, prefault, approximate,
+            downsample, decimation, store);
 
     this->init();
 }
 
 Volume::Volume(std::string filename, std::string var_name, int x, int y, int z,
-        bool memmap)
+        bool memmap, bool prefault, bool approximate, TransferFunction *tf,
+        unsigned int downsample, DECIMATION decimation,
+        SharedVolumeStore *store) :
+    transferFunction(tf), ownsTransferFunction(false), version(0),
+    statsPending(false),
+    lowPercentile(0.0), highPercentile(100.0)
 {
     this->ID = createID();
     //volumes contain a datafile
     //one datafile per volume, one volume per renderer/camera
     this->dataFile = new DataFile(x, y, z);
-    this->loadFromFile(filename, var_name, memmap);
+    this->loadFromFile(filename, var_name, memmap, prefault,
+            approximate, downsample, decimation, store);
+
+    this->init();
+}
 
+Volume::Volume(DataFile *df, TransferFunction *tf) :
+    dataFile(df), transferFunction(tf), ownsTransferFunction(false),
+    version(0), statsPending(false),
+    lowPercentile(0.0), highPercentile(100.0)
+{
+    this->ID = createID();
     this->init();
 }
 
+Volume *Volume::createInterpolated(Volume *a, Volume *b, float weight,
+        TransferFunction *tf)
+{
+    // the blend is laid out in space like a
+    DataFile *source = a->dataFile;
+    DataFile *blended = new DataFile(source->xDim, source->yDim,
+            source->zDim);
+    blended->downsample = source->downsample;
+    blended->decimation = source->decimation;
+    blended->fileXDim = source->fileXDim;
+    blended->fileYDim = source->fileYDim;
+    blended->fileZDim = source->fileZDim;
+
+    // the macrocells of both come with their exact statistics
+    a->getMacrocells();
+    b->getMacrocells();
+    // volumes that can't be blended show a
+    if(!blended->interpolate(a->dataFile, b->dataFile, weight) &&
+            !blended->interpolate(source, source, 0.0)) {
+        delete blended;
+        return NULL;
+    }
+    return new Volume(blended, tf);
+}
+
 void Volume::init()
 {
-    //set up default transfer function
-    this->transferFunction = new TransferFunction();
-    this->transferFunction->setRange(this->dataFile->minVal,
-                                     this->dataFile->maxVal);
+    //set up default transfer function unless we were given a shared one
+    if(this->transferFunction == NULL) {
+        this->transferFunction = new TransferFunction();
+        this->ownsTransferFunction = true;
+        this->transferFunction->setRange(this->dataFile->minVal,
+                                         this->dataFile->maxVal);
+    }
+
+    //rays will sample the data in no particular order, so stop readahead
+    //and start paging in the whole file in the background
+    this->dataFile->adviseAccess(ACCESS_RANDOM);
+    this->dataFile->adviseAccess(ACCESS_WILLNEED);
 
     //setup OSPRay objects
+    //quantized data is rendered as it is stored, with the voxel and
+    //transfer function ranges moved into its units
+    OSPDataType dataType = OSP_FLOAT;
+    const char *voxelType = "float";
+    void *voxels = this->dataFile->data;
+    if(this->dataFile->quantizedBits == 8) {
+        dataType = OSP_UCHAR;
+        voxelType = "uchar";
+        voxels = this->dataFile->quantizedData;
+    }
+    else if(this->dataFile->quantizedBits == 16) {
+        dataType = OSP_USHORT;
+        voxelType = "ushort";
+        voxels = this->dataFile->quantizedData;
+    }
     this->oVolume = ospNewVolume("shared_structured_volume");
-    this->oData = ospNewData(this->dataFile->numValues, OSP_FLOAT, 
-            this->dataFile->data, OSP_DATA_SHARED_BUFFER);
+    this->oData = ospNewData(this->dataFile->numValues, dataType, voxels,
+            OSP_DATA_SHARED_BUFFER);
 
     int dimensions[3] = {this->dataFile->xDim, 
                         this->dataFile->yDim,
                         this->dataFile->zDim};
-    float center[3] = {-dimensions[0]/(float)2.0,
-                      -dimensions[1]/(float)2.0,
-                      -dimensions[2]/(float)2.0};
-    float voxelRange[3] = {this->dataFile->minVal, 
-                          this->dataFile->maxVal};
+    // a downsampled volume is spread out over the space the file's
+    // voxels take up, averaged values sit in the middle of their boxes
+    int fileDimensions[3] = {this->dataFile->fileXDim,
+                            this->dataFile->fileYDim,
+                            this->dataFile->fileZDim};
+    this->gridSpacing = this->dataFile->downsample;
+    float boxCenter = 0.0;
+    if(this->dataFile->decimation == DECIMATE_AVERAGE)
+        boxCenter = (this->gridSpacing - 1)/(float)2.0;
+    for(int axis = 0; axis < 3; axis++)
+        this->gridOrigin[axis] = -fileDimensions[axis]/(float)2.0 + boxCenter;
+    float spacing[3] = {this->gridSpacing, this->gridSpacing,
+                       this->gridSpacing};
+    std::vector<float> voxelRange = this->toSampleValues({
+            this->dataFile->minVal, this->dataFile->maxVal});
 
     // There is a memory leak here caused by OSPRay
     // more info in destructor
     ospSetData(this->oVolume, "voxelData", this->oData);
     ospSet3iv(this->oVolume, "dimensions", dimensions);
-    ospSetString(this->oVolume, "voxelType", "float");
-    ospSet2fv(this->oVolume, "voxelRange", voxelRange);
-    ospSet3fv(this->oVolume, "gridOrigin", center);
-    ospSetObject(this->oVolume, "transferFunction",
-            this->transferFunction->asOSPObject());
+    ospSetString(this->oVolume, "voxelType", voxelType);
+    ospSet2fv(this->oVolume, "voxelRange", voxelRange.data());
+    ospSet3fv(this->oVolume, "gridOrigin", this->gridOrigin);
+    ospSet3fv(this->oVolume, "gridSpacing", spacing);
+    this->transferFunction->commit();
+    this->oScaledTransferFunction = NULL;
+    this->attachTransferFunction();
     ospCommit(this->oVolume);
+
+    // update() crops to the visible voxels once the macrocells are there
+    this->cropping = true;
+    this->cropStale = true;
+    this->cropOpacityVersion = 0;
+    this->cropIsoLow = INFINITY;
+    this->cropIsoHigh = -INFINITY;
+
+    if(this->dataFile->statsApproximate) {
+        // render with the estimate for now, update() picks up the exact
+        // statistics once this finishes
+        DataFile *df = this->dataFile;
+        this->exactStatistics = std::async(std::launch::async,
+                [df]() { return df->computeStatistics(); });
+        this->statsPending = true;
+    }
 }
 
 Volume::~Volume()
 {
+    // the background statistics pass reads the data, let it finish
+    if(this->exactStatistics.valid())
+        delete this->exactStatistics.get().macrocells;
+    for(auto mesh = this->meshes.begin(); mesh != this->meshes.end(); mesh++)
+        delete *mesh;
+
     // Memory leak in OSPRay
     // User-set parameters cannot be removed and deallocated
     // As such, all calls to ospSet*() create copies of the objects
@@ -78,7 +193,11 @@ Volume::~Volume()
     //           this is when ospRemoveParam() was officially released
     delete this->dataFile;
     this->dataFile = NULL;
-    delete this->transferFunction;
+    if(this->oScaledTransferFunction != NULL)
+        this->transferFunction->releaseScaledOSPObject(
+                this->oScaledTransferFunction);
+    if(this->ownsTransferFunction)
+        delete this->transferFunction;
     this->transferFunction = NULL;
     ospRelease(this->oVolume);
     ospRelease(this->oData);
@@ -99,6 +218,97 @@ void Volume::setOpacityMap(std::vector<float> &map)
     this->transferFunction->setOpacityMap(map);
 }
 
+void Volume::setRangePercentiles(float low, float high)
+{
+    if(low < 0.0 || high > 100.0 || low >= high) {
+        std::cerr << "Invalid percentile range " << low << " to " << high;
+        std::cerr << std::endl;
+        return;
+    }
+
+    this->lowPercentile = low;
+    this->highPercentile = high;
+    // percentiles need exact statistics, update() applies them if those
+    // are still being computed
+    if(!this->statsPending)
+        this->applyValueRange();
+}
+
+std::vector<float> Volume::getValueRange()
+{
+    // percentiles need the exact statistics
+    bool clamped = this->lowPercentile > 0.0 || this->highPercentile < 100.0;
+    if(clamped)
+        this->finishStatistics();
+
+    float minimum = this->dataFile->minVal;
+    float maximum = this->dataFile->maxVal;
+    if(this->lowPercentile > 0.0)
+        minimum = this->dataFile->getPercentile(this->lowPercentile);
+    if(this->highPercentile < 100.0)
+        maximum = this->dataFile->getPercentile(this->highPercentile);
+
+    // nearly constant data can collapse the range
+    if(minimum >= maximum) {
+        minimum = this->dataFile->minVal;
+        maximum = this->dataFile->maxVal;
+    }
+    std::vector<float> range = {minimum, maximum};
+    return range;
+}
+
+void Volume::applyValueRange()
+{
+    // a shared transfer function's range covers every volume sharing it,
+    // so it only widens, e.g. when exact statistics replace an estimate
+    if(this->transferFunction->isRangeFixed())
+        return;
+    std::vector<float> range = this->getValueRange();
+    if(this->ownsTransferFunction)
+        this->transferFunction->setRange(range[0], range[1]);
+    else
+        this->transferFunction->includeRange(range[0], range[1]);
+}
+
+void Volume::setTransferFunction(TransferFunction *tf)
+{
+    if(tf == NULL || tf == this->transferFunction)
+        return;
+
+    if(this->oScaledTransferFunction != NULL)
+        this->transferFunction->releaseScaledOSPObject(
+                this->oScaledTransferFunction);
+    this->oScaledTransferFunction = NULL;
+    if(this->ownsTransferFunction)
+        delete this->transferFunction;
+    this->transferFunction = tf;
+    this->ownsTransferFunction = false;
+    this->cropStale = true;
+
+    this->transferFunction->commit();
+    this->attachTransferFunction();
+    ospCommit(this->oVolume);
+    this->version++;
+}
+
+void Volume::attachTransferFunction()
+{
+    OSPTransferFunction oTF = this->transferFunction->asOSPObject();
+    if(this->dataFile->quantizedBits != 0) {
+        this->oScaledTransferFunction =
+            this->transferFunction->createScaledOSPObject(
+                    this->dataFile->quantizeOffset,
+                    this->dataFile->quantizeScale);
+        oTF = this->oScaledTransferFunction;
+    }
+    ospSetObject(this->oVolume, "transferFunction", oTF);
+}
+
+TransferFunction *Volume::getTransferFunction()
+{
+    return this->transferFunction;
+}
+
 std::vector<int> Volume::getBounds()
 {
     std::vector<int> bounds = {this->dataFile->xDim, this->dataFile->yDim,
@@ -106,17 +316,326 @@ std::vector<int> Volume::getBounds()
     return bounds;
 }
 
+std::vector<float> Volume::getGridOrigin()
+{
+    std::vector<float> origin(this->gridOrigin, this->gridOrigin + 3);
+    return origin;
+}
+
+float Volume::getGridSpacing()
+{
+    return this->gridSpacing;
+}
+
+unsigned int Volume::getDownsample()
+{
+    return this->dataFile->downsample;
+}
+
+unsigned int Volume::getQuantizedBits()
+{
+    return this->dataFile->quantizedBits;
+}
+
+float Volume::getQuantizationError()
+{
+    return this->dataFile->quantizeError;
+}
+
+std::vector<float> Volume::toSampleValues(const std::vector<float> &values)
+{
+    std::vector<float> samples = values;
+    if(this->dataFile->quantizedBits == 0)
+        return samples;
+    for(int i = 0; i < samples.size(); i++)
+        samples[i] = (samples[i] - this->dataFile->quantizeOffset) /
+            this->dataFile->quantizeScale;
+    return samples;
+}
+
+unsigned long int Volume::getVersion()
+{
+    return this->version;
+}
+
+bool Volume::blend(Volume *a, Volume *b, float weight)
+{
+    // the macrocells of both come with their exact statistics
+    a->getMacrocells();
+    b->getMacrocells();
+    return this->dataFile->interpolate(a->dataFile, b->dataFile, weight);
+}
+
+bool Volume::interpolate(Volume *a, Volume *b, float weight)
+{
+    if(!this->blend(a, b, weight))
+        return false;
+
+    // meshes and crops of the old values no longer fit
+    for(auto mesh = this->meshes.begin(); mesh != this->meshes.end(); mesh++)
+        delete *mesh;
+    this->meshes.clear();
+    this->cropStale = true;
+    this->applyValueRange();
+    std::vector<float> voxelRange = this->toSampleValues({
+            this->dataFile->minVal, this->dataFile->maxVal});
+    ospSet2fv(this->oVolume, "voxelRange", voxelRange.data());
+    ospCommit(this->oVolume);
+    this->version++;
+    return true;
+}
+
+DataFile *Volume::releaseDataFile()
+{
+    // the background statistics pass may still be reading it
+    this->finishStatistics();
+    DataFile *df = this->dataFile;
+    this->dataFile = NULL;
+    return df;
+}
+
+Histogram *Volume::getHistogram(unsigned int numBins)
+{
+    // bins span the exact value range, so wait for it if it's still
+    // being computed, the next update() passes it on to OSPRay
+    this->finishStatistics();
+    return this->dataFile->getHistogram(numBins);
+}
+
+TriangleMesh *Volume::getIsosurfaceMesh(float isovalue)
+{
+    // extraction skips bricks using the exact statistics pass
+    this->finishStatistics();
+    for(auto mesh = this->meshes.begin(); mesh != this->meshes.end(); mesh++) {
+        if((*mesh)->isovalue == isovalue) {
+            this->meshes.splice(this->meshes.begin(), this->meshes, mesh);
+            return this->meshes.front();
+        }
+    }
+
+    // quantized data is expanded back to floats just for the extraction
+    if(this->dataFile->quantizedBits != 0) {
+        DataFile *expanded = this->dataFile->dequantize();
+        this->meshes.push_front(new TriangleMesh(expanded, isovalue));
+        delete expanded;
+    }
+    else
+        this->meshes.push_front(new TriangleMesh(this->dataFile, isovalue));
+    while(this->meshes.size() > MAX_MESHES) {
+        delete this->meshes.back();
+        this->meshes.pop_back();
+    }
+    return this->meshes.front();
+}
+
+MacrocellGrid *Volume::getMacrocells()
+{
+    // the grid comes with the exact statistics
+    this->finishStatistics();
+    return this->dataFile->getMacrocells();
+}
+
+std::vector<bool> Volume::getVisibleBricks()
+{
+    return this->getMacrocells()->getVisibleBricks(this->transferFunction);
+}
+
+std::vector<int> Volume::getVisibleBounds()
+{
+    MacrocellGrid *grid = this->getMacrocells();
+    std::vector<int> bounds = grid->getBounds(
+            grid->getVisibleBricks(this->transferFunction));
+    if(bounds.empty())
+        return bounds;
+
+    // the bricks only bound the visible voxels, so move each face of the
+    // box in until it touches one
+    // bins of values with no opacity anywhere rule most voxels out
+    // quickly, the rest are looked up exactly
+    const int numBins = 1024;
+    float minimum = this->dataFile->minVal;
+    float binWidth = (this->dataFile->maxVal - minimum) / numBins;
+    std::vector<bool> visibleBin(numBins);
+    for(int b = 0; b < numBins; b++)
+        visibleBin[b] = this->transferFunction->getMaxOpacity(
+                minimum + b*binWidth, minimum + (b + 1)*binWidth) > 0.0;
+    float scale = binWidth > 0 ? 1.0/binWidth : 0.0;
+
+    long int nx = this->dataFile->xDim, ny = this->dataFile->yDim;
+    DataFile *df = this->dataFile;
+    auto valueAt = [df](long int i) {
+        if(df->quantizedBits == 8)
+            return df->quantizeOffset + df->quantizeScale *
+                ((const unsigned char *)df->quantizedData)[i];
+        if(df->quantizedBits == 16)
+            return df->quantizeOffset + df->quantizeScale *
+                ((const unsigned short *)df->quantizedData)[i];
+        return df->data[i];
+    };
+    TransferFunction *tf = this->transferFunction;
+    auto planeVisible = [&](int axis, int index) {
+        int lo[3] = {bounds[0], bounds[1], bounds[2]};
+        int hi[3] = {bounds[3], bounds[4], bounds[5]};
+        lo[axis] = hi[axis] = index;
+        for(long int z = lo[2]; z <= hi[2]; z++)
+        for(long int y = lo[1]; y <= hi[1]; y++)
+        for(long int x = lo[0]; x <= hi[0]; x++) {
+            float value = valueAt(x + nx*(y + ny*z));
+            float bin = (value - minimum) * scale;
+            // also catches NaNs
+            if(!(bin >= 0))
+                bin = 0;
+            if(visibleBin[std::min(numBins - 1, (int)bin)] &&
+                    tf->getMaxOpacity(value, value) > 0.0)
+                return true;
+        }
+        return false;
+    };
+    for(int axis = 0; axis < 3; axis++) {
+        while(bounds[axis] < bounds[axis + 3] &&
+                !planeVisible(axis, bounds[axis]))
+            bounds[axis]++;
+        while(bounds[axis + 3] > bounds[axis] &&
+                !planeVisible(axis, bounds[axis + 3]))
+            bounds[axis + 3]--;
+        // the visible bricks may not hold a single visible voxel
+        if(bounds[axis] == bounds[axis + 3] &&
+                !planeVisible(axis, bounds[axis]))
+            return std::vector<int>();
+    }
+    return bounds;
+}
+
+void Volume::setCropping(bool crop)
+{
+    this->cropping = crop;
+    this->cropStale = true;
+}
+
+void Volume::includeIsovalues(const std::vector<float> &values)
+{
+    for(int i = 0; i < values.size(); i++) {
+        if(values[i] < this->cropIsoLow || values[i] > this->cropIsoHigh)
+            this->cropStale = true;
+        this->cropIsoLow = std::min(this->cropIsoLow, values[i]);
+        this->cropIsoHigh = std::max(this->cropIsoHigh, values[i]);
+    }
+}
+
+std::vector<int> Volume::getCropBounds()
+{
+    return this->cropBounds;
+}
+
+void Volume::applyCropping()
+{
+    this->cropOpacityVersion = this->transferFunction->getOpacityVersion();
+    this->cropStale = false;
+
+    // samples between a visible voxel and its neighbours can be visible
+    // too, so the box keeps one more voxel on each side
+    std::vector<int> dims = this->getBounds();
+    std::vector<int> box;
+    if(this->cropping)
+        box = this->getVisibleBounds();
+    if(this->cropping && this->cropIsoLow <= this->cropIsoHigh) {
+        // the surfaces can be anywhere in a brick holding their values
+        MacrocellGrid *grid = this->getMacrocells();
+        std::vector<bool> bricks(grid->getNumBricks());
+        for(long int b = 0; b < bricks.size(); b++)
+            bricks[b] = grid->overlapsRange(b, this->cropIsoLow,
+                    this->cropIsoHigh);
+        std::vector<int> surfaces = grid->getBounds(bricks);
+        for(int axis = 0; axis < 3 && !box.empty() && !surfaces.empty();
+                axis++) {
+            surfaces[axis] = std::min(surfaces[axis], box[axis]);
+            surfaces[axis + 3] = std::max(surfaces[axis + 3],
+                    box[axis + 3]);
+        }
+        if(!surfaces.empty())
+            box = surfaces;
+    }
+    bool whole = true;
+    for(int axis = 0; axis < 3 && !box.empty(); axis++) {
+        box[axis] = std::max(box[axis] - 1, 0);
+        box[axis + 3] = std::min(box[axis + 3] + 1, dims[axis] - 1);
+        whole = whole && box[axis] == 0 && box[axis + 3] == dims[axis] - 1;
+    }
+    // nothing to crop if everything or nothing is visible
+    if(whole)
+        box.clear();
+    if(box == this->cropBounds)
+        return;
+    this->cropBounds = box;
+
+    // the clipping box is in the same centered coordinates as the grid,
+    // equal corners turn clipping off
+    float lower[3] = {0, 0, 0};
+    float upper[3] = {0, 0, 0};
+    for(int axis = 0; axis < 3 && !box.empty(); axis++) {
+        lower[axis] = this->gridOrigin[axis] + box[axis]*this->gridSpacing;
+        upper[axis] = this->gridOrigin[axis] +
+            box[axis + 3]*this->gridSpacing;
+    }
+    ospSet3fv(this->oVolume, "volumeClippingBoxLower", lower);
+    ospSet3fv(this->oVolume, "volumeClippingBoxUpper", upper);
+    ospCommit(this->oVolume);
+    this->version++;
+}
+
 OSPVolume Volume::asOSPRayObject()
 {
     return this->oVolume;
 }
 
+void Volume::finishStatistics()
+{
+    if(this->exactStatistics.valid())
+        this->dataFile->setStatistics(this->exactStatistics.get());
+}
+
+void Volume::update()
+{
+    // transfer function changes are batched up until the frame starts
+    this->transferFunction->commit();
+
+    if(this->statsPending && (!this->exactStatistics.valid() ||
+                this->exactStatistics.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready)) {
+        // exact statistics have arrived, widen the ranges to match
+        this->finishStatistics();
+        this->statsPending = false;
+        this->applyValueRange();
+        this->transferFunction->commit();
+        float voxelRange[2] = {this->dataFile->minVal,
+            this->dataFile->maxVal};
+        ospSet2fv(this->oVolume, "voxelRange", voxelRange);
+        ospCommit(this->oVolume);
+        this->version++;
+        // the statistics pass asked for sequential readahead
+        this->dataFile->adviseAccess(ACCESS_RANDOM);
+    }
+
+    // the crop needs the macrocells from the exact statistics
+    if(!this->statsPending && (this->cropStale || this->cropOpacityVersion !=
+                this->transferFunction->getOpacityVersion()))
+        this->applyCropping();
+}
+
 void Volume::loadFromFile(std::string filename, std::string var_name,
-        bool memmap)
+        bool memmap, bool prefault, bool approximate,
+        unsigned int downsample, DECIMATION decimation,
+        SharedVolumeStore *store)
 {
-    this->dataFile->loadFromFile(filename, var_name, memmap);
+    this->dataFile->setSharedStore(store);
+    this->dataFile->loadFromFile(filename, var_name, memmap, prefault,
+            downsample, decimation);
     //this is slooooow :(
-    this->dataFile->calculateStatistics();
+    //so optionally start from an estimate and finish it in the background
+    if(approximate)
+        this->dataFile->estimateStatistics();
+    else
+        this->dataFile->calculateStatistics();
     //this->dataFile->printStatistics();
 }
 
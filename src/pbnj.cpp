@@ -2,11 +2,12 @@
 
 #include <ospray/ospray.h>
 
-#include <chrono>
-#include <iostream>
-#include <string>
-#include <stdio.h>
-#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
 
 namespace pbnj {
 
@@ -18,41 +19,51 @@ void pbnjInit(int *argc, const char **argv)
     ospInit(argc, argv);
 }
 
-std::string createID()
+unsigned long int createID()
 {
-    // IDs are composed of a MAC address followed by a time
-    FILE *arp = fopen("/proc/net/arp", "r");
-    if(arp == NULL) {
-        std::cerr << "WARNING: Could not open /proc/net/arp. ";
-        std::cerr << "Object IDs won't work." << std::endl;
-        return "";
-    }
+    // zero is never handed out so it can mean "no object"
+    static std::atomic<unsigned long int> nextID(1);
+    return nextID++;
+}
+
+unsigned int getNumThreads()
+{
+    // hardware_concurrency may return 0 if it can't tell
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
 
-    char buffer[1024];
-    // read the column headers
-    char *header = fgets(buffer, 1024, arp);
-    if(header == NULL) {
-        std::cerr << "WARNING: Unexpected format in /proc/net/arp. ";
-        std::cerr << "Object IDs won't work." << std::endl;
+std::string getFileIdentity(std::string filename)
+{
+    struct stat info;
+    if(stat(filename.c_str(), &info) != 0)
         return "";
-    }
+    return std::to_string(info.st_dev) + ":" + std::to_string(info.st_ino) +
+        ":" + std::to_string(info.st_size) + ":" +
+        std::to_string(info.st_mtim.tv_sec) + "." +
+        std::to_string(info.st_mtim.tv_nsec);
+}
 
-    fgets(buffer, 1024, arp);
+void parallelFor(long int count,
+        std::function<void(unsigned int, long int, long int)> func)
+{
+    if(count <= 0)
+        return;
 
-    // what are for loops?
-    char *macaddr;
-    macaddr = strtok(buffer, " ");
-    macaddr = strtok(NULL, " ");
-    macaddr = strtok(NULL, " ");
-    macaddr = strtok(NULL, " ");
+    long int numThreads = std::min((long int)getNumThreads(), count);
+    long int chunk = (count + numThreads - 1) / numThreads;
 
-    // current time in milliseconds
-    unsigned long int ms = std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    // the calling thread takes the first chunk
+    std::vector<std::thread> threads;
+    for(long int t = 1; t < numThreads; t++) {
+        long int begin = std::min(count, t*chunk);
+        long int end = std::min(count, begin + chunk);
+        threads.push_back(std::thread(func, (unsigned int)t, begin, end));
+    }
+    func(0, 0, std::min(count, chunk));
 
-    std::string ID(macaddr);
-    
-    return ID + ":" + std::to_string(ms);
+    for(int t = 0; t < threads.size(); t++)
+        threads[t].join();
 }
 
 }
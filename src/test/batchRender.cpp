@@ -0,0 +1,35 @@
+#include "pbnj.h"
+#include "BatchRenderer.h"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, const char **argv)
+{
+    if(argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <jobs.json | config_dir> ";
+        std::cerr << "[more jobs...] [-m max_memory_gb] [-w workers]";
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    // read every job before OSPRay is initialized
+    pbnj::BatchRenderer *batch = new pbnj::BatchRenderer();
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "-m" && i + 1 < argc)
+            batch->setMaxMemory(std::stoi(argv[++i]));
+        else if(arg == "-w" && i + 1 < argc)
+            batch->setNumWorkers(std::stoi(argv[++i]));
+        else
+            batch->addJobs(arg);
+    }
+
+    pbnj::pbnjInit(&argc, argv);
+
+    batch->run();
+    batch->printTimings();
+
+    delete batch;
+    return 0;
+}
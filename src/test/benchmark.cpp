@@ -58,10 +58,6 @@ int main(int argc, const char **argv)
     std::uniform_int_distribution<> cam_x(-2*config->dataXDim, 2*config->dataXDim);
     std::uniform_int_distribution<> cam_y(-2*config->dataYDim, 2*config->dataYDim);
     std::uniform_int_distribution<> cam_z(-2*config->dataZDim, 2*config->dataZDim);
-    // default ramp opacity map to reset the volume's opacity
-    std::vector<float> ramp;
-    for(int i = 0; i < 256; i++)
-        ramp.push_back(i/255.0);
     // open CSV file and write headers to it
     std::ofstream csv;
     if(png_benchmark)
@@ -94,7 +90,7 @@ int main(int argc, const char **argv)
 
                 // time the total iterations and get an average
                 for(int iter_index = 0; iter_index < iterations; iter_index++) {
-                    // set current attenuation and reset after rendering
+                    // attenuation replaces the previous one, no reset needed
                     volume->attenuateOpacity(current_attenuation);
                     // setup a random camera
                     pbnj::Camera *camera = new pbnj::Camera(
@@ -126,8 +122,6 @@ int main(int argc, const char **argv)
                             std::to_string(current_samples) + ".png";
                         lodepng::save_file(png_data, image_fname.c_str());
                     }
-                    // reset opacity map
-                    volume->setOpacityMap(ramp);
                 }
                 //auto duration = std::chrono::duration_cast
                 //    <std::chrono::nanoseconds>(end - begin).count();
@@ -0,0 +1,59 @@
+#include "pbnj.h"
+#include "Configuration.h"
+#include "Renderer.h"
+#include "TriangleMesh.h"
+#include "Volume.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+int main(int argc, const char **argv)
+{
+    if(argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <config_file.json> <out.ply>";
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    pbnj::Configuration *config = new pbnj::Configuration(argv[1]);
+    pbnj::CONFSTATE confState = config->getConfigState();
+    if(confState != pbnj::SINGLE_NOVAR && confState != pbnj::SINGLE_VAR) {
+        std::cerr << "ERROR: config needs a single data filename";
+        std::cerr << std::endl;
+        return 1;
+    }
+    if(config->isosurfaceValues.empty()) {
+        std::cerr << "ERROR: config has no isosurfaceValues" << std::endl;
+        return 1;
+    }
+
+    pbnj::pbnjInit(&argc, argv);
+
+    pbnj::Volume *volume = new pbnj::Volume(config->dataFilename,
+            config->dataVariable, config->dataXDim, config->dataYDim,
+            config->dataZDim);
+
+    // one file per isovalue, numbered if there is more than one
+    std::string filename = argv[2];
+    for(int i = 0; i < config->isosurfaceValues.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        pbnj::TriangleMesh *mesh = volume->getIsosurfaceMesh(
+                config->isosurfaceValues[i]);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << "isovalue " << mesh->isovalue << ": ";
+        std::cout << mesh->getNumTriangles() << " triangles, ";
+        std::cout << mesh->getNumVertices() << " vertices in ";
+        std::cout << elapsed.count() << " s" << std::endl;
+
+        if(config->isosurfaceValues.size() == 1)
+            mesh->save(filename);
+        else
+            mesh->save(pbnj::Renderer::frameFilename(filename, i));
+    }
+
+    delete volume;
+    delete config;
+    return 0;
+}
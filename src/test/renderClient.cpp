@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// sends each line of stdin to a renderServer as a request and saves the
+// frames that come back as <prefix>0000.png, <prefix>0001.png, ...
+
+int connectTo(std::string where)
+{
+    int fd;
+    if(where.find_first_not_of("0123456789") == std::string::npos) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(std::stoi(where));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+            return -1;
+    }
+    else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, where.c_str(), sizeof(addr.sun_path) - 1);
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+            return -1;
+    }
+    return fd;
+}
+
+// reads up to and including the next newline, or exactly count bytes
+bool readLine(int fd, std::string &line)
+{
+    line.clear();
+    char c;
+    while(recv(fd, &c, 1, 0) == 1) {
+        if(c == '\n')
+            return true;
+        line += c;
+    }
+    return false;
+}
+
+bool readBytes(int fd, std::vector<char> &data, size_t count)
+{
+    data.resize(count);
+    size_t got = 0;
+    while(got < count) {
+        ssize_t result = recv(fd, data.data() + got, count - got, 0);
+        if(result <= 0)
+            return false;
+        got += result;
+    }
+    return true;
+}
+
+int main(int argc, const char **argv)
+{
+    if(argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <port | unix_socket_path> ";
+        std::cerr << "[output_prefix] < requests" << std::endl;
+        return 1;
+    }
+    std::string prefix = argc > 2 ? argv[2] : "frame";
+
+    int server = connectTo(argv[1]);
+    if(server == -1) {
+        std::cerr << "Could not connect to " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::string request;
+    unsigned int count = 0;
+    while(std::getline(std::cin, request)) {
+        request += "\n";
+        send(server, request.data(), request.size(), MSG_NOSIGNAL);
+
+        std::string header;
+        if(!readLine(server, header))
+            break;
+        std::cout << header << std::endl;
+
+        // the reply says how much image data follows
+        std::string::size_type at = header.find("\"bytes\": ");
+        size_t bytes = at == std::string::npos ? 0 :
+            std::stoul(header.substr(at + 9));
+        if(bytes == 0)
+            continue;
+        std::vector<char> data;
+        if(!readBytes(server, data, bytes))
+            break;
+
+        bool raw = header.find("\"format\": \"raw\"") != std::string::npos;
+        std::string number = std::to_string(count++);
+        number.insert(0, 4 - std::min((size_t)4, number.length()), '0');
+        std::ofstream image(prefix + number + (raw ? ".rgba" : ".png"),
+                std::ios::binary);
+        image.write(data.data(), data.size());
+    }
+
+    close(server);
+    return 0;
+}
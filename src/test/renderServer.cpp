@@ -0,0 +1,37 @@
+#include "pbnj.h"
+#include "RenderServer.h"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, const char **argv)
+{
+    if(argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <config_file.json> ";
+        std::cerr << "<port | unix_socket_path>" << std::endl;
+        return 1;
+    }
+
+    pbnj::RenderServer *server = new pbnj::RenderServer(argv[1]);
+
+    pbnj::pbnjInit(&argc, argv);
+
+    // anything that isn't a port number is taken as a socket path
+    std::string where = argv[2];
+    bool listening;
+    if(where.find_first_not_of("0123456789") == std::string::npos)
+        listening = server->listenTCP(std::stoi(where));
+    else
+        listening = server->listenUnix(where);
+    if(!listening)
+        return 1;
+
+    if(server->getPort() != 0)
+        std::cout << "Listening on port " << server->getPort() << std::endl;
+    else
+        std::cout << "Listening on " << where << std::endl;
+    server->serve();
+
+    delete server;
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "pbnj.h"
+#include "RenderServer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// starts a renderServer on a free port, talks to it over the loopback
+// interface and checks its replies, including to requests it must refuse
+
+struct Check {
+    std::string request;
+    std::string status;
+    bool image;
+};
+
+// reads up to and including the next newline
+bool readLine(int fd, std::string &line)
+{
+    line.clear();
+    char c;
+    while(recv(fd, &c, 1, 0) == 1) {
+        if(c == '\n')
+            return true;
+        line += c;
+    }
+    return false;
+}
+
+bool skipBytes(int fd, size_t count)
+{
+    std::vector<char> data(4096);
+    while(count > 0) {
+        ssize_t result = recv(fd, data.data(),
+                std::min(count, data.size()), 0);
+        if(result <= 0)
+            return false;
+        count -= result;
+    }
+    return true;
+}
+
+int main(int argc, const char **argv)
+{
+    if(argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <config_file.json>";
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    pbnj::RenderServer *server = new pbnj::RenderServer(argv[1]);
+
+    pbnj::pbnjInit(&argc, argv);
+
+    if(!server->listenTCP(0))
+        return 1;
+    std::thread serving([server]() { server->serve(); });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server->getPort());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        std::cerr << "Could not connect to port " << server->getPort();
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    // one at a time, so none of them are coalesced
+    std::vector<Check> checks = {
+        {"{\"render\": false}", "ok", false},
+        {"{\"cameraPosition\": \"far away\"}", "error", false},
+        {"{\"samplesPerPixel\": -1}", "error", false},
+        {"{\"cameraPath\": {\"keyframes\": [{\"time\": 0}]}}", "error",
+            false},
+        {"not json", "error", false},
+        {"{\"cameraPosition\": [0, 0, 512], \"imageSize\": [64, 64]}", "ok",
+            true},
+        {"{\"shutdown\": true}", "ok", false}
+    };
+
+    int failed = 0;
+    for(int c = 0; c < checks.size(); c++) {
+        std::string request = checks[c].request + "\n";
+        send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+
+        std::string header;
+        if(!readLine(fd, header)) {
+            std::cout << "FAIL " << checks[c].request << ": no reply";
+            std::cout << std::endl;
+            failed++;
+            break;
+        }
+        std::string::size_type at = header.find("\"bytes\": ");
+        size_t bytes = at == std::string::npos ? 0 :
+            std::stoul(header.substr(at + 9));
+        skipBytes(fd, bytes);
+
+        bool passed = header.find("\"status\": \"" + checks[c].status +
+                "\"") != std::string::npos &&
+            (bytes > 0) == checks[c].image;
+        std::cout << (passed ? "PASS " : "FAIL ") << checks[c].request;
+        std::cout << " -> " << header << std::endl;
+        if(!passed)
+            failed++;
+    }
+
+    close(fd);
+    serving.join();
+    delete server;
+    return failed == 0 ? 0 : 1;
+}
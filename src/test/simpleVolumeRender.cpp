@@ -1,7 +1,9 @@
 #include "pbnj.h"
 #include "Camera.h"
+#include "CameraPath.h"
 #include "Configuration.h"
 #include "Renderer.h"
+#include "SharedVolumeStore.h"
 #include "TimeSeries.h"
 #include "TransferFunction.h"
 #include "Volume.h"
@@ -9,17 +11,6 @@
 #include <iostream>
 #include <string>
 
-std::string imageFamily(std::string filename, unsigned int count)
-{
-    std::string::size_type index;
-    index = filename.rfind('.');
-    std::string base = filename.substr(0, index);
-    std::string family = std::to_string(count);
-    family.insert(0, 4 - family.length(), '0');
-    std::string ext = filename.substr(index);
-    return base + family + ext;
-}
-
 int main(int argc, const char **argv)
 {
     if(argc != 2) {
@@ -40,6 +31,12 @@ int main(int argc, const char **argv)
     pbnj::TimeSeries *timeSeries;
     bool single = true;
 
+    // other processes rendering the same data can map this one's copy
+    pbnj::SharedVolumeStore *store = NULL;
+    if(config->sharedMemory > 0)
+        store = new pbnj::SharedVolumeStore(config->sharedMemory *
+                1073741824L);
+
     // there are 2 invalid cases:
     //  - no data filename(s) provided
     //  - both a single and multiple filenames provided
@@ -56,13 +53,16 @@ int main(int argc, const char **argv)
         case pbnj::SINGLE_NOVAR:
             std::cout << "Single volume, no variable" << std::endl;
             volume = new pbnj::Volume(config->dataFilename, config->dataXDim,
-                    config->dataYDim, config->dataZDim);
+                    config->dataYDim, config->dataZDim, false, false,
+                    config->approximateStats, NULL, config->downsample,
+                    config->decimation, store);
             break;
         case pbnj::SINGLE_VAR:
             std::cout << "Single volume, variable" << std::endl;
             volume = new pbnj::Volume(config->dataFilename,
                     config->dataVariable, config->dataXDim, config->dataYDim,
-                    config->dataZDim);
+                    config->dataZDim, false, false, config->approximateStats,
+                    NULL, config->downsample, config->decimation, store);
             break;
         case pbnj::MULTI_NOVAR:
             std::cout << "Multiple volumes, no variable" << std::endl;
@@ -72,6 +72,15 @@ int main(int argc, const char **argv)
             timeSeries->setOpacityMap(config->opacityMap);
             timeSeries->setOpacityAttenuation(config->opacityAttenuation);
             timeSeries->setMemoryMapping(true);
+            timeSeries->setApproximateStatistics(config->approximateStats);
+            timeSeries->setDownsample(config->downsample, config->decimation);
+            timeSeries->setQuantization(config->quantizeBits);
+            timeSeries->setSharedStore(store);
+            timeSeries->setRangePercentiles(config->rangeLowPercentile,
+                    config->rangeHighPercentile);
+            if(config->valueRange.size() == 2)
+                timeSeries->setValueRange(config->valueRange[0],
+                        config->valueRange[1]);
             single = false;
             break;
         case pbnj::MULTI_VAR:
@@ -83,6 +92,15 @@ int main(int argc, const char **argv)
             timeSeries->setOpacityMap(config->opacityMap);
             timeSeries->setOpacityAttenuation(config->opacityAttenuation);
             timeSeries->setMemoryMapping(true);
+            timeSeries->setApproximateStatistics(config->approximateStats);
+            timeSeries->setDownsample(config->downsample, config->decimation);
+            timeSeries->setQuantization(config->quantizeBits);
+            timeSeries->setSharedStore(store);
+            timeSeries->setRangePercentiles(config->rangeLowPercentile,
+                    config->rangeHighPercentile);
+            if(config->valueRange.size() == 2)
+                timeSeries->setValueRange(config->valueRange[0],
+                        config->valueRange[1]);
             single = false;
     }
 
@@ -110,15 +128,33 @@ int main(int argc, const char **argv)
         volume->setOpacityMap(config->opacityMap);
         volume->setOpacityMap(config->opacityMap);
         volume->attenuateOpacity(config->opacityAttenuation);
+        if(config->rangeLowPercentile > 0.0 ||
+                config->rangeHighPercentile < 100.0)
+            volume->setRangePercentiles(config->rangeLowPercentile,
+                    config->rangeHighPercentile);
+        if(config->valueRange.size() == 2)
+            volume->getTransferFunction()->fixRange(config->valueRange[0],
+                    config->valueRange[1]);
 
         // set up the renderer and get an image
+        renderer->setIsosurfaceMeshes(config->isosurfaceMeshes);
         if(config->isosurfaceValues.size() == 0)
             renderer->setVolume(volume);
         else
             renderer->setIsosurface(volume, config->isosurfaceValues);
-        renderer->renderImage(config->imageFilename);
-
-        std::cout << "Rendered image to " << config->imageFilename << std::endl;
+        if(config->cameraPathType.empty()) {
+            renderer->renderImage(config->imageFilename);
+            std::cout << "Rendered image to " << config->imageFilename;
+            std::cout << std::endl;
+        }
+        else {
+            // render a family of images along the configured path
+            pbnj::CameraPath *path = new pbnj::CameraPath(config);
+            renderer->renderPath(camera, path, config->cameraPathFrames,
+                    config->imageFilename);
+            std::cout << "Rendered " << config->cameraPathFrames;
+            std::cout << " frames along a camera path" << std::endl;
+        }
     }
     else {
         // we have a series of volumes
@@ -131,7 +167,8 @@ int main(int argc, const char **argv)
             //volume->attenuateOpacity(config->opacityAttenuation);
 
             // modify the config filename so we have a family of images
-            std::string imageFilename = imageFamily(config->imageFilename, v);
+            std::string imageFilename = pbnj::Renderer::frameFilename(
+                    config->imageFilename, v);
 
             // set the current volume as the one to render
             // this erases the last volume in the renderer
@@ -0,0 +1,55 @@
+#include "pbnj.h"
+#include "Configuration.h"
+#include "ThumbnailRenderer.h"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, const char **argv)
+{
+    if(argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <config.json> ";
+        std::cerr << "[-s width height] [-d downsample] [-m max_memory_gb] ";
+        std::cerr << "[-w workers] [-r renderers] [-o montage.png] ";
+        std::cerr << "[-c columns]" << std::endl;
+        return 1;
+    }
+
+    pbnj::Configuration *config = new pbnj::Configuration(argv[1]);
+    pbnj::ThumbnailRenderer *thumbnails =
+        new pbnj::ThumbnailRenderer(config);
+    std::string montage;
+    unsigned int columns = 0;
+    for(int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "-s" && i + 2 < argc) {
+            int width = std::stoi(argv[++i]);
+            thumbnails->setImageSize(width, std::stoi(argv[++i]));
+        }
+        else if(arg == "-d" && i + 1 < argc)
+            thumbnails->setDownsample(std::stoi(argv[++i]));
+        else if(arg == "-m" && i + 1 < argc)
+            thumbnails->setMaxMemory(std::stoi(argv[++i]));
+        else if(arg == "-w" && i + 1 < argc)
+            thumbnails->setNumWorkers(std::stoi(argv[++i]));
+        else if(arg == "-r" && i + 1 < argc)
+            thumbnails->setNumRenderers(std::stoi(argv[++i]));
+        else if(arg == "-o" && i + 1 < argc)
+            montage = argv[++i];
+        else if(arg == "-c" && i + 1 < argc)
+            columns = std::stoi(argv[++i]);
+        else
+            std::cerr << "WARNING: ignoring argument " << arg << std::endl;
+    }
+
+    pbnj::pbnjInit(&argc, argv);
+
+    thumbnails->run();
+    if(!montage.empty())
+        thumbnails->saveMontage(montage, columns);
+    thumbnails->printTimings();
+
+    delete thumbnails;
+    delete config;
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "pbnj.h"
+#include "Configuration.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+
+// modification time of a file, 0 if it can't be read
+long int modificationTime(std::string filename)
+{
+    struct stat info;
+    if(stat(filename.c_str(), &info) != 0)
+        return 0;
+    return info.st_mtim.tv_sec * 1000000000L + info.st_mtim.tv_nsec;
+}
+
+std::string describeChanges(unsigned int changes)
+{
+    std::string description;
+    if(changes & pbnj::CHANGE_DATA) description += " data";
+    if(changes & pbnj::CHANGE_TRANSFERFUNCTION) description += " transfer";
+    if(changes & pbnj::CHANGE_RANGE) description += " range";
+    if(changes & pbnj::CHANGE_CAMERA) description += " camera";
+    if(changes & pbnj::CHANGE_CAMERAPATH) description += " path";
+    if(changes & pbnj::CHANGE_RENDERER) description += " renderer";
+    if(changes & pbnj::CHANGE_OUTPUT) description += " output";
+    if(description.empty()) description = " nothing";
+    return description;
+}
+
+int main(int argc, const char **argv)
+{
+    if(argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <config_file.json>" << std::endl;
+        return 1;
+    }
+
+    std::string configFilename = argv[1];
+    pbnj::Configuration *config = new pbnj::Configuration(configFilename);
+    long int lastModified = modificationTime(configFilename);
+
+    pbnj::pbnjInit(&argc, argv);
+
+    pbnj::Scene *scene = new pbnj::Scene(config);
+    scene->getRenderer()->renderImage(config->imageFilename);
+    std::cout << "Rendered image to " << config->imageFilename << std::endl;
+    delete config;
+
+    // rerender whenever the config file is saved, only rebuilding the
+    // parts of the scene that the edit touched
+    while(true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        long int modified = modificationTime(configFilename);
+        if(modified == lastModified)
+            continue;
+        lastModified = modified;
+
+        auto start = std::chrono::steady_clock::now();
+        config = new pbnj::Configuration(configFilename);
+        unsigned int changes = scene->apply(config);
+        scene->getRenderer()->renderImage(config->imageFilename);
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << "Changed:" << describeChanges(changes) << ", rendered ";
+        std::cout << config->imageFilename << " in ";
+        std::cout << std::chrono::duration<double, std::milli>(
+                end - start).count() << " ms" << std::endl;
+        delete config;
+    }
+
+    delete scene;
+    return 0;
+}